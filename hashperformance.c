@@ -1,18 +1,42 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdarg.h>
+#include <math.h>
 #include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include "large_alloc.h"
+#include "typed_table.h"
+
+/**
+ * The 64 bit golden ratio 2^64 / phi, the multiplier of Fibonacci hashing. It is odd, so multiplying by it
+ * is a bijection on 64 bit keys.
+ */
+#define FIBONACCI_MULTIPLIER 0x9e3779b97f4a7c15ULL
 
 /**
  * Struct for the Hash Context
+ * shift moves the top capacity_pow2exp bits of a 64 bit product down to a slot index.
  */
 typedef struct hash_context
 {
-    unsigned long long mult_A;
     unsigned int capacity_pow2exp;
-    unsigned int capacity;
+    unsigned int shift;
+    size_t capacity;
 } hash_context;
 
 /**
@@ -22,13 +46,27 @@ typedef struct probe_context
 {
     hash_context *hash_ctx;
     int key;
-    unsigned int hash1;
-    unsigned int hash2;
+    size_t hash1;
+    size_t hash2;
     size_t capacity;
 } probe_context;
 
 // A general typedef for every probe function
-typedef size_t probe_func(probe_context *ctx, int i);
+typedef size_t probe_func(probe_context *ctx, size_t i);
+
+/**
+ * Identifies a probe sequence, so a loop can be compiled for it directly.
+ * PROBE_INDIRECT calls the table's probe function through its pointer instead.
+ */
+typedef enum
+{
+    PROBE_INDIRECT,
+    PROBE_LINEAR,
+    PROBE_QUADRATIC,
+    PROBE_DOUBLEHASH,
+} probe_kind;
+
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
 
 /**
  * Struct for the hash table entries
@@ -36,11 +74,32 @@ typedef size_t probe_func(probe_context *ctx, int i);
 typedef struct
 {
     bool exists;
+    // The entry was removed, lookups have to probe past it
+    bool deleted;
     int value;
 } hash_table_entry;
 
+/**
+ * Determines how the slots of the hash table are stored.
+ * 
+ * LAYOUT_PADDED stores a hash_table_entry per slot, which is 8 bytes with padding.
+ * LAYOUT_SENTINEL stores only the key, and marks empty slots with EMPTY_KEY and removed ones with TOMBSTONE_KEY.
+ * Since those keys cannot be stored in a slot, the table remembers separately whether it contains them.
+ * LAYOUT_BITMAP stores only the key, and keeps a bit per slot telling whether it is used and one whether it was removed.
+ */
+typedef enum
+{
+    LAYOUT_PADDED,
+    LAYOUT_SENTINEL,
+    LAYOUT_BITMAP,
+} slot_layout;
+
+const int EMPTY_KEY = INT_MIN;
+const int TOMBSTONE_KEY = INT_MIN + 1;
+
 /**
  * Struct for the Hash Table
+ * Depending on the layout, the slots are either in 'values', or in 'keys' (and 'occupied').
  */
 typedef struct
 {
@@ -48,7 +107,15 @@ typedef struct
     size_t capacity;
     size_t entries;
     size_t collisions;
+    // Slots of removed entries, which are reused by later adds
+    size_t tombstones;
+    slot_layout layout;
     hash_table_entry *values;
+    int *keys;
+    uint64_t *occupied;
+    uint64_t *deleted;
+    bool contains_empty_key;
+    bool contains_tombstone_key;
 
     probe_func *probe;
     hash_context hash_ctx;
@@ -65,27 +132,166 @@ void swap(int *a, int *b)
 }
 
 /**
- * Create random array
- * which creates a random array with all unique numbers
- * from c lib rand() function and our own way of multiplication
- * to ensure unique numbers
+ * Most keys an int key set can have. Keys are the non-negative ints, as before.
+ */
+#define MAX_INT_KEYS ((size_t)INT_MAX + 1)
+
+/**
+ * Returns the i-th key of the seeded int key set.
+ * Every step is a bijection on 31 bit numbers (adding, multiplying by an odd number and
+ * xor with a right shift, all modulo 2^31), so different i give different keys
+ * without remembering which keys were handed out. The order looks random, so no shuffle is needed.
+ */
+int unique_key(uint64_t i, uint64_t seed)
+{
+    const uint32_t mask = INT_MAX;
+    uint32_t x = (uint32_t)(i + seed) & mask;
+    x ^= x >> 16;
+    x = (x * 0x7feb352dU) & mask;
+    x ^= x >> 15;
+    x = (x + (uint32_t)(seed >> 32)) & mask;
+    x = (x * 0x846ca68bU) & mask;
+    x ^= x >> 16;
+    return (int)x;
+}
+
+/**
+ * Returns the i-th key of the seeded 64 bit key set, the same way as unique_key with the
+ * bijective murmur3 finalizer on all 64 bits.
  */
-int *create_random_unique_array(size_t length)
+uint64_t unique_key64(uint64_t i, uint64_t seed)
 {
-    const int step = INT_MAX / length;
-    const int start = 0;
-    int *array = calloc(length, sizeof(int));
-    int acc = 0;
-    for (size_t i = 0; i < length; i++)
+    uint64_t x = i + seed;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x += seed >> 17 | 1;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * A range of a key set, filled by one thread.
+ */
+typedef struct
+{
+    void *keys;
+    bool wide;
+    size_t begin;
+    size_t end;
+    uint64_t seed;
+    pthread_t thread;
+} key_generator_job;
+
+void *key_generator_run(void *arg)
+{
+    key_generator_job *job = arg;
+    for (size_t i = job->begin; i < job->end; i++)
     {
-        acc += ((rand() % step) + 1);
-        array[i] = acc;
+        if (job->wide)
+        {
+            ((uint64_t *)job->keys)[i] = unique_key64(i, job->seed);
+        }
+        else
+        {
+            ((int *)job->keys)[i] = unique_key(i, job->seed);
+        }
     }
-    for (size_t i = 0; i < length; i++)
+    return NULL;
+}
+
+/**
+ * Fills keys with the first length keys of the seeded key set, split over every online core.
+ * wide selects 64 bit keys instead of int keys.
+ */
+void generate_unique_keys(void *keys, size_t length, bool wide, uint64_t seed)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores < 1 ? 1 : cores > 64 ? 64 : cores;
+    key_generator_job jobs[64];
+
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t] = (key_generator_job){
+            .keys = keys,
+            .wide = wide,
+            .begin = length * t / threads,
+            .end = length * (t + 1) / threads,
+            .seed = seed,
+        };
+        if (t > 0 && pthread_create(&jobs[t].thread, NULL, key_generator_run, &jobs[t]) != 0)
+        {
+            // Fill the range on the calling thread instead
+            key_generator_run(&jobs[t]);
+            jobs[t].end = jobs[t].begin;
+        }
+    }
+    key_generator_run(&jobs[0]);
+    for (int t = 1; t < threads; t++)
+    {
+        if (jobs[t].end > jobs[t].begin)
+        {
+            pthread_join(jobs[t].thread, NULL);
+        }
+    }
+}
+
+/**
+ * Returns an array of length unique keys from the seeded key set, or NULL if there are not that many.
+ * If cache_dir is set, the keys are read from a file there when a run with the same length and seed
+ * already wrote one, and written to it otherwise.
+ */
+void *create_unique_keys(size_t length, bool wide, uint64_t seed, const char *cache_dir)
+{
+    const size_t key_size = wide ? sizeof(uint64_t) : sizeof(int);
+    if (!wide && length > MAX_INT_KEYS)
+    {
+        fprintf(stderr, "There are only %zu unique int keys.\n", MAX_INT_KEYS);
+        return NULL;
+    }
+    void *keys = malloc(length * key_size);
+    if (!keys)
+    {
+        return NULL;
+    }
+
+    char path[4096];
+    if (cache_dir)
+    {
+        snprintf(path, sizeof(path), "%s/keys-%d-%zu-%llu.bin", cache_dir, wide ? 64 : 32, length, (unsigned long long)seed);
+        FILE *file = fopen(path, "rb");
+        if (file)
+        {
+            size_t read = fread(keys, key_size, length, file);
+            fclose(file);
+            if (read == length)
+            {
+                return keys;
+            }
+        }
+    }
+
+    generate_unique_keys(keys, length, wide, seed);
+
+    if (cache_dir)
     {
-        swap(&array[i], &array[rand() % length]);
+        // Write to a temporary file first, so a concurrent run never reads a partial key set
+        char temp_path[4096 + 16];
+        snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, (int)getpid());
+        FILE *file = fopen(temp_path, "wb");
+        bool written = file && fwrite(keys, key_size, length, file) == length;
+        if (file && fclose(file) != 0)
+        {
+            written = false;
+        }
+        if (!written || rename(temp_path, path) != 0)
+        {
+            fprintf(stderr, "Could not write the key cache '%s'.\n", path);
+            remove(temp_path);
+        }
     }
-    return array;
+    return keys;
 }
 
 /**
@@ -95,7 +301,7 @@ int *create_random_unique_array(size_t length)
 size_t pow2_round_exponent(size_t value)
 {
     const int bits = sizeof(size_t) * CHAR_BIT;
-    if (value & 1 << (bits - 1))
+    if (value & (size_t)1 << (bits - 1))
     {
         return 0;
     }
@@ -117,6 +323,21 @@ size_t pow2_round(size_t value)
     return (size_t)1 << pow2_round_exponent(value);
 }
 
+/**
+ * Returns the index of the name in the array of mode names, or -1 if it is not there.
+ */
+int find_mode_name(const char *const names[], int names_length, const char *name)
+{
+    for (int i = 0; i < names_length; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /**
 * Calculates and returns the loadfactor.
 */
@@ -126,67 +347,449 @@ float get_load_factor(hash_table *table)
 }
 
 /**
- * Determines the capacity and context 
- * with the equation 0.5*2^x (sqrt(5)-1)
+ * Determines the context for a capacity of 2^capacity_pow2exp slots.
+ * A table of one slot keeps a shift of 63, since shifting by 64 is undefined; its mask is 0 anyway.
  */
-void hash_context_init(hash_table *table)
+hash_context hash_context_create(size_t capacity, size_t capacity_pow2exp)
 {
-    const double sqrt5 = 2.236067977;
-    table->hash_ctx = (hash_context){
-        .mult_A = (unsigned long long)(0.5 * table->capacity * (sqrt5 - 1)),
-        .capacity_pow2exp = table->capacity_pow2exp,
-        .capacity = table->capacity,
+    return (hash_context){
+        .capacity_pow2exp = capacity_pow2exp,
+        .shift = capacity_pow2exp == 0 ? 63 : 64 - capacity_pow2exp,
+        .capacity = capacity,
     };
 }
 
 /**
-* First hashing function with a multiplicative implementation
+ * Determines the context for the table's capacity
+ */
+void hash_context_init(hash_table *table)
+{
+    table->hash_ctx = hash_context_create(table->capacity, table->capacity_pow2exp);
+}
+
+/**
+* First hashing function with a multiplicative implementation: Fibonacci hashing, the top
+* capacity_pow2exp bits of the 64 bit product with the golden ratio. Works for 64 bit keys and
+* for every capacity up to 2^63.
+* The product alone keeps the arithmetic structure of strided and low-entropy keys and leaves
+* most buckets empty, so the key is first mixed with half of the murmur3 finalizer.
 */
-unsigned int hash1(hash_context ctx, int key)
+ALWAYS_INLINE size_t hash1(hash_context ctx, uint64_t key)
 {
-    return key * ctx.mult_A >> (sizeof(int) * CHAR_BIT - ctx.capacity_pow2exp);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key * FIBONACCI_MULTIPLIER >> ctx.shift;
 }
 
 /**
-* Second hashing function with a folding hash implementation
+* Second hashing function with a folding hash implementation: xor of every capacity_pow2exp
+* bit wide piece of the 64 bit key.
 */
-unsigned int hash2(hash_context ctx, int key)
+size_t hash2(hash_context ctx, uint64_t key)
 {
-    unsigned int mask = ctx.capacity - 1;
-    unsigned int h = 0;
-    unsigned int shift = 0;
-    unsigned int capacity_pow2exp = ctx.capacity_pow2exp;
-    while (mask != 0)
+    if (ctx.capacity_pow2exp == 0)
+    {
+        return 1;
+    }
+    const uint64_t mask = ctx.capacity - 1;
+    uint64_t h = 0;
+    for (unsigned int shift = 0; shift < 64; shift += ctx.capacity_pow2exp)
     {
-        h = (mask & key) >> shift;
-        mask <<= capacity_pow2exp;
-        shift += capacity_pow2exp;
+        h ^= key >> shift & mask;
     }
 
     return h | 1; // make the number always odd at the expense of more collisions
 }
 
-size_t probe_linear(probe_context *ctx, int i)
+/**
+ * How the benchmark keys are spread over the ints. Every distribution gives unique non-negative keys,
+ * as the tables store a key again when it is added twice.
+ * KEYS_UNIFORM is the seeded key set, in random order.
+ * KEYS_SEQUENTIAL counts up from a seeded offset, like ids handed out in order.
+ * KEYS_STRIDED counts up in steps of KEY_STRIDE, so the low bits never change.
+ * KEYS_ZIPF counts up in gaps with a Zipf (s = 1) distribution, mostly dense runs with rare long jumps.
+ * KEYS_CLUSTERED is runs of KEY_CLUSTER consecutive keys at random places.
+ * KEYS_LOW_ENTROPY only varies the bits needed to tell the keys apart, at the top, and keeps the rest 0.
+ * KEYS_ADVERSARIAL only keeps the keys hash1 puts on every KEY_ADVERSARIAL_SPREAD-th slot of the table,
+ * so every home slot is shared by that many times more keys.
+ */
+typedef enum
+{
+    KEYS_UNIFORM,
+    KEYS_SEQUENTIAL,
+    KEYS_STRIDED,
+    KEYS_ZIPF,
+    KEYS_CLUSTERED,
+    KEYS_LOW_ENTROPY,
+    KEYS_ADVERSARIAL,
+    KEY_DISTRIBUTIONS,
+} key_distribution;
+
+const char *const key_distribution_names[] = {"uniform", "sequential", "strided", "zipf", "clustered", "low-entropy", "adversarial"};
+
+#define KEY_STRIDE 4096
+#define KEY_CLUSTER 64
+#define KEY_ADVERSARIAL_SPREAD 16
+
+/**
+ * Returns i permuted on numbers of the specified bits, with the steps of unique_key on a narrower mask.
+ */
+uint32_t permute_bits(uint32_t i, int bits, uint64_t seed)
+{
+    const uint32_t mask = bits >= 32 ? UINT32_MAX : ((uint32_t)1 << bits) - 1;
+    const int shift = (bits + 1) / 2;
+    uint32_t x = (uint32_t)(i + seed) & mask;
+    x ^= x >> shift;
+    x = (x * 0x7feb352dU) & mask;
+    x ^= x >> shift;
+    x = (x + (uint32_t)(seed >> 32)) & mask;
+    x = (x * 0x846ca68bU) & mask;
+    x ^= x >> shift;
+    return x;
+}
+
+/**
+ * Gets the number of bits needed to count to length.
+ */
+int count_bits(size_t length)
+{
+    int bits = 0;
+    while (((size_t)1 << bits) < length)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+/**
+ * Returns the seeded key set of the distribution, or NULL if it does not have length keys.
+ * The adversarial keys are chosen for a table with the specified capacity, the others ignore it.
+ * Only the uniform keys are cached in cache_dir, the others are quick to generate.
+ */
+int *create_key_set(key_distribution distribution, size_t length, size_t capacity, uint64_t seed, const char *cache_dir)
+{
+    if (distribution == KEYS_UNIFORM)
+    {
+        return create_unique_keys(length, false, seed, cache_dir);
+    }
+    const size_t max_length = distribution == KEYS_ADVERSARIAL ? MAX_INT_KEYS / KEY_ADVERSARIAL_SPREAD : MAX_INT_KEYS;
+    if (length > max_length)
+    {
+        fprintf(stderr, "There are only %zu unique %s int keys.\n", max_length, key_distribution_names[distribution]);
+        return NULL;
+    }
+    int *keys = malloc(length * sizeof(int));
+    if (!keys)
+    {
+        return NULL;
+    }
+
+    const int bits = count_bits(length);
+    switch (distribution)
+    {
+    case KEYS_SEQUENTIAL:
+    {
+        size_t offset = seed % (MAX_INT_KEYS - length + 1);
+        for (size_t i = 0; i < length; i++)
+        {
+            keys[i] = offset + i;
+        }
+        break;
+    }
+    case KEYS_STRIDED:
+    {
+        size_t stride = KEY_STRIDE;
+        while (stride > 1 && length * stride > MAX_INT_KEYS)
+        {
+            stride /= 2;
+        }
+        size_t offset = seed % stride;
+        for (size_t i = 0; i < length; i++)
+        {
+            keys[i] = i * stride + offset;
+        }
+        break;
+    }
+    case KEYS_ZIPF:
+    {
+        // No gap is larger than max_gap, so the last key still fits in an int
+        const double max_gap = (double)(MAX_INT_KEYS / (length ? length : 1));
+        size_t key = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            double u = (unique_key64(i, seed) >> 11) * 0x1p-53;
+            size_t gap = pow(max_gap, u);
+            key += i == 0 ? gap - 1 : (gap < 1 ? 1 : gap);
+            keys[i] = key;
+        }
+        break;
+    }
+    case KEYS_CLUSTERED:
+    {
+        const int cluster_bits = 31 - count_bits(KEY_CLUSTER);
+        for (size_t i = 0; i < length; i++)
+        {
+            keys[i] = permute_bits(i / KEY_CLUSTER, cluster_bits, seed) * KEY_CLUSTER + i % KEY_CLUSTER;
+        }
+        break;
+    }
+    case KEYS_LOW_ENTROPY:
+        for (size_t i = 0; i < length; i++)
+        {
+            keys[i] = bits == 0 ? 0 : permute_bits(i, bits, seed) << (31 - bits);
+        }
+        break;
+    case KEYS_ADVERSARIAL:
+    {
+        hash_context ctx = hash_context_create(capacity, pow2_round_exponent(capacity - 1));
+        size_t found = 0;
+        for (uint64_t i = 0; found < length && i < MAX_INT_KEYS; i++)
+        {
+            int key = unique_key(i, seed);
+            if ((hash1(ctx, key) & (capacity - 1)) % KEY_ADVERSARIAL_SPREAD == 0)
+            {
+                keys[found++] = key;
+            }
+        }
+        if (found < length)
+        {
+            fprintf(stderr, "Only found %zu of %zu adversarial int keys.\n", found, length);
+            free(keys);
+            return NULL;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return keys;
+}
+
+/*
+ * The capacity is always a power of two, so the probes reduce with a mask instead of a division.
+ */
+
+ALWAYS_INLINE size_t probe_linear_at(probe_context *ctx, size_t i)
 {
-    return (ctx->hash1 + i) % ctx->capacity;
+    return (ctx->hash1 + i) & (ctx->capacity - 1);
 }
 
-size_t probe_quadratic(probe_context *ctx, int i)
+/**
+ * Probes with the triangular numbers i(i+1)/2, which visit every slot of a power of two table.
+ */
+ALWAYS_INLINE size_t probe_quadratic_at(probe_context *ctx, size_t i)
 {
-    const double c = 0.5;
-    const double ic = i * c;
-    size_t result = (size_t)(ctx->hash1 + ic + ic * i + 1);
-    return result % ctx->capacity;
+    size_t triangle = i * (i + 1) >> 1;
+    return (ctx->hash1 + triangle + 1) & (ctx->capacity - 1);
 }
 
-size_t probe_doublehash(probe_context *ctx, int i)
+ALWAYS_INLINE size_t probe_doublehash_at(probe_context *ctx, size_t i)
 {
     // hash2 cannot be 0 as it will cancel multiplication by i
     if (ctx->hash2 == 0)
     {
         ctx->hash2 = hash2(*ctx->hash_ctx, ctx->key);
     }
-    return (ctx->hash1 + i * ctx->hash2) % ctx->capacity;
+    return (ctx->hash1 + i * ctx->hash2) & (ctx->capacity - 1);
+}
+
+size_t probe_linear(probe_context *ctx, size_t i)
+{
+    return probe_linear_at(ctx, i);
+}
+
+size_t probe_quadratic(probe_context *ctx, size_t i)
+{
+    return probe_quadratic_at(ctx, i);
+}
+
+size_t probe_doublehash(probe_context *ctx, size_t i)
+{
+    return probe_doublehash_at(ctx, i);
+}
+
+/**
+* Returns the flag telling whether v is in the table, if v is a key the layout cannot store in a slot.
+* Returns NULL for every other key.
+*/
+bool *hash_table_reserved_flag(hash_table *table, int v)
+{
+    if (table->layout != LAYOUT_SENTINEL)
+    {
+        return NULL;
+    }
+    return v == EMPTY_KEY ? &table->contains_empty_key : v == TOMBSTONE_KEY ? &table->contains_tombstone_key : NULL;
+}
+
+/**
+* Returns true if the slot never contained a value since it was cleared, which ends a probe sequence.
+*/
+bool hash_table_slot_empty(hash_table *table, size_t j)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        return !table->values[j].exists && !table->values[j].deleted;
+    case LAYOUT_SENTINEL:
+        return table->keys[j] == EMPTY_KEY;
+    default:
+        return !((table->occupied[j / 64] | table->deleted[j / 64]) >> (j % 64) & 1);
+    }
+}
+
+/**
+* Returns true if the slot holds a tombstone of a removed value.
+*/
+bool hash_table_slot_deleted(hash_table *table, size_t j)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        return table->values[j].deleted;
+    case LAYOUT_SENTINEL:
+        return table->keys[j] == TOMBSTONE_KEY;
+    default:
+        return table->deleted[j / 64] >> (j % 64) & 1;
+    }
+}
+
+/**
+* Returns true if the slot contains the value v, which must not be a reserved key.
+*/
+bool hash_table_slot_holds(hash_table *table, size_t j, int v)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        return table->values[j].exists && table->values[j].value == v;
+    case LAYOUT_SENTINEL:
+        return table->keys[j] == v;
+    default:
+        return table->keys[j] == v && table->occupied[j / 64] >> (j % 64) & 1;
+    }
+}
+
+/**
+* Returns the value in a used slot.
+*/
+int hash_table_slot_value(hash_table *table, size_t j)
+{
+    return table->layout == LAYOUT_PADDED ? table->values[j].value : table->keys[j];
+}
+
+/**
+* Stores the value in an empty or deleted slot.
+*/
+void hash_table_slot_store(hash_table *table, size_t j, int v)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        table->values[j].exists = true;
+        table->values[j].deleted = false;
+        table->values[j].value = v;
+        break;
+    case LAYOUT_SENTINEL:
+        table->keys[j] = v;
+        break;
+    default:
+        table->keys[j] = v;
+        table->occupied[j / 64] |= (uint64_t)1 << (j % 64);
+        table->deleted[j / 64] &= ~((uint64_t)1 << (j % 64));
+        break;
+    }
+}
+
+/**
+* Marks a used slot as empty again, as if it never contained a value.
+*/
+void hash_table_slot_clear(hash_table *table, size_t j)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        table->values[j].exists = false;
+        break;
+    case LAYOUT_SENTINEL:
+        table->keys[j] = EMPTY_KEY;
+        break;
+    default:
+        table->occupied[j / 64] &= ~((uint64_t)1 << (j % 64));
+        break;
+    }
+}
+
+/**
+* Replaces the value in a used slot with a tombstone.
+*/
+void hash_table_slot_delete(hash_table *table, size_t j)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        table->values[j].exists = false;
+        table->values[j].deleted = true;
+        break;
+    case LAYOUT_SENTINEL:
+        table->keys[j] = TOMBSTONE_KEY;
+        break;
+    default:
+        table->occupied[j / 64] &= ~((uint64_t)1 << (j % 64));
+        table->deleted[j / 64] |= (uint64_t)1 << (j % 64);
+        break;
+    }
+}
+
+/**
+* Returns the address of the slot, for prefetching.
+*/
+const void *hash_table_slot_address(hash_table *table, size_t j)
+{
+    return table->layout == LAYOUT_PADDED ? (const void *)&table->values[j] : (const void *)&table->keys[j];
+}
+
+/**
+* Returns the page size the slots actually got, which can be smaller than requested.
+*/
+page_mode hash_table_pages(hash_table *table)
+{
+    return large_pages(table->layout == LAYOUT_PADDED ? (void *)table->values : (void *)table->keys);
+}
+
+/**
+* Returns the number of bytes used for the slots of the hashtable.
+*/
+size_t hash_table_slot_bytes(hash_table *table)
+{
+    switch (table->layout)
+    {
+    case LAYOUT_PADDED:
+        return table->capacity * sizeof(hash_table_entry);
+    case LAYOUT_SENTINEL:
+        return table->capacity * sizeof(int);
+    default:
+        return table->capacity * sizeof(int) + 2 * ((table->capacity + 63) / 64 * sizeof(uint64_t));
+    }
+}
+
+/**
+* Returns slot i of the probe sequence. With a constant kind the switch folds away
+* and the probe is inlined into the calling loop.
+*/
+ALWAYS_INLINE size_t hash_table_probe(hash_table *table, probe_kind kind, probe_context *ctx, size_t i)
+{
+    switch (kind)
+    {
+    case PROBE_LINEAR:
+        return probe_linear_at(ctx, i);
+    case PROBE_QUADRATIC:
+        return probe_quadratic_at(ctx, i);
+    case PROBE_DOUBLEHASH:
+        return probe_doublehash_at(ctx, i);
+    default:
+        return table->probe(ctx, i);
+    }
 }
 
 /**
@@ -195,7 +798,7 @@ size_t probe_doublehash(probe_context *ctx, int i)
 * to antoher key until it finds a free on. 
 * Returns number of collisions until value got placed. 
 */
-size_t hash_table_add(hash_table *table, int v)
+ALWAYS_INLINE size_t hash_table_add_probed(hash_table *table, int v, probe_kind kind)
 {
     const size_t capacity = table->capacity;
     hash_context *hash_ctx = &table->hash_ctx;
@@ -209,38 +812,75 @@ size_t hash_table_add(hash_table *table, int v)
 
     size_t colls = 0;
 
-    for (int i = 0; i < capacity; i++)
+    // The sentinel keys cannot be stored in a slot, so they take the side path.
+    bool *reserved = hash_table_reserved_flag(table, v);
+    if (reserved)
+    {
+        if (!*reserved)
+        {
+            *reserved = true;
+            table->entries++;
+        }
+        return colls;
+    }
+
+    for (size_t i = 0; i < capacity; i++)
     {
-        int j = table->probe(&ctx, i);
-        hash_table_entry *value = &table->values[j];
-        if (!value->exists)
+        size_t j = hash_table_probe(table, kind, &ctx, i);
+        bool deleted = hash_table_slot_deleted(table, j);
+        if (deleted || hash_table_slot_empty(table, j))
         {
-            value->exists = true;
-            value->value = v;
+            hash_table_slot_store(table, j, v);
             table->entries++;
+            table->tombstones -= deleted;
             break;
         }
         colls++;
     }
     if (colls == table->capacity)
     {
-        printf("Table full, laddies/lassies!\n");
+        fprintf(stderr, "Table full, laddies/lassies!\n");
     }
 
     return colls;
 }
+
+size_t hash_table_add(hash_table *table, int v)
+{
+    return hash_table_add_probed(table, v, PROBE_INDIRECT);
+}
+
 /**
-* Creates a hashtable with a specified capacity and probe function.
+* Creates a hashtable with a specified capacity, probe function and slot layout.
 * The hashtable capacity is set to the closest power two, larger than 
 * the specified min_capacity.
+* The slots are allocated with the page size and NUMA placement of memory, or with calloc if it is NULL.
 */
-hash_table *hash_table_create(size_t min_capacity, probe_func *probe)
+hash_table *hash_table_create(size_t min_capacity, probe_func *probe, slot_layout layout, const memory_options *memory)
 {
     hash_table *table = calloc(1, sizeof(hash_table));
     table->capacity_pow2exp = pow2_round_exponent(min_capacity);
     table->capacity = pow2_round(min_capacity);
-    table->values = calloc(table->capacity, sizeof(hash_table_entry));
-    table->probe = probe;
+    table->layout = layout;
+    switch (layout)
+    {
+    case LAYOUT_PADDED:
+        table->values = large_alloc(table->capacity * sizeof(hash_table_entry), memory);
+        break;
+    case LAYOUT_SENTINEL:
+        table->keys = large_alloc(table->capacity * sizeof(int), memory);
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            table->keys[i] = EMPTY_KEY;
+        }
+        break;
+    case LAYOUT_BITMAP:
+        table->keys = large_alloc(table->capacity * sizeof(int), memory);
+        table->occupied = large_alloc((table->capacity + 63) / 64 * sizeof(uint64_t), memory);
+        table->deleted = large_alloc((table->capacity + 63) / 64 * sizeof(uint64_t), memory);
+        break;
+    }
+    table->probe = probe;
     hash_context_init(table);
     return table;
 }
@@ -250,10 +890,172 @@ hash_table *hash_table_create(size_t min_capacity, probe_func *probe)
 */
 void hash_table_free(hash_table *table)
 {
-    free(table->values);
+    large_free(table->values);
+    large_free(table->keys);
+    large_free(table->occupied);
+    large_free(table->deleted);
     free(table);
 }
 
+/**
+* Takes the page faults of every array of the table up front.
+*/
+void hash_table_prefault(hash_table *table)
+{
+    if (table->values)
+    {
+        prefault(table->values, table->capacity * sizeof(hash_table_entry));
+    }
+    if (table->keys)
+    {
+        prefault(table->keys, table->capacity * sizeof(int));
+    }
+    if (table->occupied)
+    {
+        prefault(table->occupied, (table->capacity + 63) / 64 * sizeof(uint64_t));
+        prefault(table->deleted, (table->capacity + 63) / 64 * sizeof(uint64_t));
+    }
+}
+
+/**
+* Looks up a value in the specified hashtable.
+* Probes along the same sequence as hash_table_add until it finds
+* the value or an empty slot.
+* Returns true if the value is in the table.
+*/
+bool hash_table_lookup(hash_table *table, int v)
+{
+    hash_context *hash_ctx = &table->hash_ctx;
+    probe_context ctx = (probe_context){
+        .hash_ctx = hash_ctx,
+        .key = v,
+        .capacity = table->capacity,
+        .hash1 = hash1(*hash_ctx, v),
+        .hash2 = 0,
+    };
+
+    bool *reserved = hash_table_reserved_flag(table, v);
+    if (reserved)
+    {
+        return *reserved;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        size_t j = table->probe(&ctx, i);
+        if (hash_table_slot_empty(table, j))
+        {
+            return false;
+        }
+        if (hash_table_slot_holds(table, j, v))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* Removes the value from the table by replacing it with a tombstone.
+* Lookups probe past tombstones and adds reuse them, so the probe sequences of other values stay intact.
+* Returns true if the value was in the table.
+*/
+bool hash_table_remove(hash_table *table, int v)
+{
+    hash_context *hash_ctx = &table->hash_ctx;
+    probe_context ctx = (probe_context){
+        .hash_ctx = hash_ctx,
+        .key = v,
+        .capacity = table->capacity,
+        .hash1 = hash1(*hash_ctx, v),
+        .hash2 = 0,
+    };
+
+    bool *reserved = hash_table_reserved_flag(table, v);
+    if (reserved)
+    {
+        bool contained = *reserved;
+        *reserved = false;
+        table->entries -= contained;
+        return contained;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        size_t j = table->probe(&ctx, i);
+        if (hash_table_slot_empty(table, j))
+        {
+            return false;
+        }
+        if (hash_table_slot_holds(table, j, v))
+        {
+            hash_table_slot_delete(table, j);
+            table->entries--;
+            table->tombstones++;
+            return true;
+        }
+    }
+    return false;
+}
+
+#define LOOKUP_BATCH_SIZE 16
+
+/**
+* Looks up n values in the specified hashtable and writes whether
+* keys[i] was found to found_out[i].
+* The first slot of every key in a group is computed and prefetched
+* before any of them are probed, so the cache misses overlap.
+*/
+void hash_table_lookup_batch(hash_table *table, const int keys[], size_t n, bool *found_out)
+{
+    hash_context *hash_ctx = &table->hash_ctx;
+    probe_context ctxs[LOOKUP_BATCH_SIZE];
+    size_t first[LOOKUP_BATCH_SIZE];
+
+    for (size_t base = 0; base < n; base += LOOKUP_BATCH_SIZE)
+    {
+        size_t count = n - base < LOOKUP_BATCH_SIZE ? n - base : LOOKUP_BATCH_SIZE;
+        for (size_t i = 0; i < count; i++)
+        {
+            int v = keys[base + i];
+            ctxs[i] = (probe_context){
+                .hash_ctx = hash_ctx,
+                .key = v,
+                .capacity = table->capacity,
+                .hash1 = hash1(*hash_ctx, v),
+                .hash2 = 0,
+            };
+            first[i] = table->probe(&ctxs[i], 0);
+            __builtin_prefetch(hash_table_slot_address(table, first[i]));
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            bool *reserved = hash_table_reserved_flag(table, ctxs[i].key);
+            if (reserved)
+            {
+                found_out[base + i] = *reserved;
+                continue;
+            }
+
+            bool found = false;
+            size_t j = first[i];
+            for (size_t k = 1; k <= table->capacity; j = table->probe(&ctxs[i], k++))
+            {
+                if (hash_table_slot_empty(table, j))
+                {
+                    break;
+                }
+                if (hash_table_slot_holds(table, j, ctxs[i].key))
+                {
+                    found = true;
+                    break;
+                }
+            }
+            found_out[base + i] = found;
+        }
+    }
+}
+
 /**
 * Adds all values from an array to the specified hashtable.
 * Returns the amount of collisions occuring while adding values.
@@ -268,75 +1070,3153 @@ size_t hash_table_add_all(hash_table *table, int *values, size_t values_length)
     return col;
 }
 
-int main(int argc, char *argv[])
+/*
+ * The same loop specialized for each probe sequence, without a function pointer call per probe.
+ * The table's probe function must match the sequence.
+ */
+
+size_t hash_table_add_all_linear(hash_table *table, int *values, size_t values_length)
+{
+    size_t col = 0;
+    for (size_t i = 0; i < values_length; i++)
+    {
+        col += hash_table_add_probed(table, values[i], PROBE_LINEAR);
+    }
+    return col;
+}
+
+size_t hash_table_add_all_quadratic(hash_table *table, int *values, size_t values_length)
+{
+    size_t col = 0;
+    for (size_t i = 0; i < values_length; i++)
+    {
+        col += hash_table_add_probed(table, values[i], PROBE_QUADRATIC);
+    }
+    return col;
+}
+
+size_t hash_table_add_all_doublehash(hash_table *table, int *values, size_t values_length)
+{
+    size_t col = 0;
+    for (size_t i = 0; i < values_length; i++)
+    {
+        col += hash_table_add_probed(table, values[i], PROBE_DOUBLEHASH);
+    }
+    return col;
+}
+
+/**
+ * Size of the neighbourhood a hopscotch entry is kept in, counted from its home slot.
+ */
+#define HOPSCOTCH_NEIGHBORHOOD 32
+
+/**
+ * Returns the first slot of the probe sequence for the value.
+ */
+size_t hash_table_home(hash_table *table, int v)
+{
+    return hash1(table->hash_ctx, v) & (table->capacity - 1);
+}
+
+/**
+ * Returns how many slots the entry in slot j sits after its home slot on the linear probe sequence.
+ */
+size_t hash_table_displacement(hash_table *table, size_t j)
+{
+    size_t home = hash_table_home(table, hash_table_slot_value(table, j));
+    return (j - home) & (table->capacity - 1);
+}
+
+/**
+ * Adds the value with Robin Hood insertion on the linear probe sequence.
+ * When the value has travelled further from its home than the entry in a slot,
+ * it takes the slot and the entry continues the search instead.
+ * This evens out the probe lengths, while lookups stay plain linear probing.
+ * Returns the number of used slots passed until every entry has a slot.
+ */
+size_t hash_table_add_robin_hood(hash_table *table, int v)
 {
-    int column_size = 11;
+    const size_t mask = table->capacity - 1;
+    size_t colls = 0;
 
-    const struct
+    if (hash_table_reserved_flag(table, v))
     {
-        const char *name;
-        probe_func *probe;
-    } probe_types[] = {
-        {"linear", &probe_linear},
-        {"quadratic", &probe_quadratic},
-        {"double-hash", &probe_doublehash}};
-    const int probe_types_length = sizeof(probe_types) / sizeof(probe_types[0]);
+        return hash_table_add(table, v);
+    }
+
+    size_t j = hash_table_home(table, v);
+    size_t distance = 0;
+    for (size_t i = 0; i < table->capacity; i++, j = (j + 1) & mask, distance++)
+    {
+        if (hash_table_slot_empty(table, j))
+        {
+            hash_table_slot_store(table, j, v);
+            table->entries++;
+            return colls;
+        }
+        colls++;
+        size_t resident_distance = hash_table_displacement(table, j);
+        if (resident_distance < distance)
+        {
+            int resident = hash_table_slot_value(table, j);
+            hash_table_slot_store(table, j, v);
+            v = resident;
+            distance = resident_distance;
+        }
+    }
+    fprintf(stderr, "Table full, laddies/lassies!\n");
+    return colls;
+}
 
-    const float fill_ratios[] = {0.5, 0.8, 0.9, 0.99, 1.0};
-    const int fill_ratios_length = sizeof(fill_ratios) / sizeof(fill_ratios[0]);
+/**
+ * Removes the value from a Robin Hood table by backward-shift deletion:
+ * the entries after it move one slot back until one is in its home slot or a slot is empty.
+ * That keeps the table as if the value was never added, so no tombstones are needed.
+ * Returns true if the value was in the table.
+ */
+bool hash_table_remove_robin_hood(hash_table *table, int v)
+{
+    const size_t mask = table->capacity - 1;
 
-    int table_bound = 10000000;
+    if (hash_table_reserved_flag(table, v))
+    {
+        return hash_table_remove(table, v);
+    }
 
-    if (argc > 1) //User can specify capaicity
+    size_t j = hash_table_home(table, v);
+    for (size_t i = 0; i < table->capacity; i++, j = (j + 1) & mask)
     {
-        table_bound = atoi(argv[1]);
+        if (hash_table_slot_empty(table, j))
+        {
+            return false;
+        }
+        if (hash_table_slot_value(table, j) == v)
+        {
+            break;
+        }
+        if (i + 1 == table->capacity)
+        {
+            return false;
+        }
     }
 
-    srand(time(NULL));
+    size_t next = (j + 1) & mask;
+    while (!hash_table_slot_empty(table, next) && hash_table_displacement(table, next) > 0)
+    {
+        int moved = hash_table_slot_value(table, next);
+        hash_table_slot_clear(table, j);
+        hash_table_slot_store(table, j, moved);
+        j = next;
+        next = (next + 1) & mask;
+    }
+    hash_table_slot_clear(table, j);
+    table->entries--;
+    return true;
+}
 
-    int table_size = pow2_round(table_bound);
+/**
+ * Adds the value with hopscotch hashing on the linear probe sequence.
+ * The first empty slot is found by linear probing, then moved back towards the home slot
+ * by moving entries forward into it, until it is within HOPSCOTCH_NEIGHBORHOOD of home.
+ * The table has a fixed capacity, so if no entry can be moved the value stays
+ * in the slot that was reached. The slots between home and any entry are never empty,
+ * so lookups stay plain linear probing.
+ * Returns the number of used slots passed until an empty slot was found.
+ */
+size_t hash_table_add_hopscotch(hash_table *table, int v)
+{
+    const size_t mask = table->capacity - 1;
+    size_t colls = 0;
 
-    printf("Generating %d unique numbers...\n\n", table_size);
-    int *rand_array = create_random_unique_array(table_size);
+    if (hash_table_reserved_flag(table, v))
+    {
+        return hash_table_add(table, v);
+    }
 
-    for (int i = 0; i < probe_types_length; i++)
+    size_t home = hash_table_home(table, v);
+    size_t free_slot = home;
+    while (!hash_table_slot_empty(table, free_slot))
     {
-        printf("Creating tables (load 50%%-100%%) for %s\n", probe_types[i].name);
-        printf(
-            "%*s | %*s | %*s | %*s | %*s\n",
-            column_size, "Load-factor",
-            column_size, "Capacity",
-            column_size, "Entries",
-            column_size, "Collisions",
-            column_size, "Time (ms)");
-        for (int j = 0; j < fill_ratios_length; j++)
+        colls++;
+        if (colls == table->capacity)
         {
-            struct timespec start, end;
-            float fill_ratio = fill_ratios[j];
-            hash_table *table = hash_table_create(table_bound, probe_types[i].probe);
+            fprintf(stderr, "Table full, laddies/lassies!\n");
+            return colls;
+        }
+        free_slot = (free_slot + 1) & mask;
+    }
 
-            if (clock_gettime(CLOCK_REALTIME, &start))
+    while (((free_slot - home) & mask) >= HOPSCOTCH_NEIGHBORHOOD)
+    {
+        bool moved = false;
+        // Try the entry furthest back first, it moves the free slot the most
+        for (size_t d = HOPSCOTCH_NEIGHBORHOOD - 1; d > 0; d--)
+        {
+            size_t candidate = (free_slot - d) & mask;
+            size_t candidate_home = hash_table_home(table, hash_table_slot_value(table, candidate));
+            if (((free_slot - candidate_home) & mask) < HOPSCOTCH_NEIGHBORHOOD)
             {
-                printf("Time failure");
-                return -1;
+                hash_table_slot_store(table, free_slot, hash_table_slot_value(table, candidate));
+                hash_table_slot_clear(table, candidate);
+                free_slot = candidate;
+                moved = true;
+                break;
             }
-            size_t col = hash_table_add_all(table, rand_array, table_size * fill_ratio);
+        }
+        if (!moved)
+        {
+            break;
+        }
+    }
 
-            if (clock_gettime(CLOCK_REALTIME, &end))
-            {
-                printf("Time failure");
-                return -1;
-            }
-            printf("%*.0f%% | %*lu | %*lu | %*lu | %*.3f\n",
-                   column_size - 1, get_load_factor(table),
-                   column_size, table->capacity,
-                   column_size, table->entries,
-                   column_size, col,
-                   column_size, (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0);
+    hash_table_slot_store(table, free_slot, v);
+    table->entries++;
+    return colls;
+}
 
-            hash_table_free(table);
+size_t hash_table_add_all_robin_hood(hash_table *table, int *values, size_t values_length)
+{
+    size_t col = 0;
+    for (size_t i = 0; i < values_length; i++)
+    {
+        col += hash_table_add_robin_hood(table, values[i]);
+    }
+    return col;
+}
+
+size_t hash_table_add_all_hopscotch(hash_table *table, int *values, size_t values_length)
+{
+    size_t col = 0;
+    for (size_t i = 0; i < values_length; i++)
+    {
+        col += hash_table_add_hopscotch(table, values[i]);
+    }
+    return col;
+}
+
+/**
+ * Returns the number of slots a lookup of the value inspects, 1 if it is in its home slot.
+ */
+size_t hash_table_probe_length(hash_table *table, int v)
+{
+    probe_context ctx = (probe_context){
+        .hash_ctx = &table->hash_ctx,
+        .key = v,
+        .capacity = table->capacity,
+        .hash1 = hash1(table->hash_ctx, v),
+        .hash2 = 0,
+    };
+
+    if (hash_table_reserved_flag(table, v))
+    {
+        return 1;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        size_t j = table->probe(&ctx, i);
+        if (hash_table_slot_empty(table, j) || hash_table_slot_holds(table, j, v))
+        {
+            return i + 1;
         }
-        printf("\n");
     }
-    return 0;
-}
\ No newline at end of file
+    return table->capacity;
+}
+
+/**
+ * Number of slots in a cuckoo bucket. A bucket of ints is 16 bytes, so 4 fit on a cache line.
+ */
+#define CUCKOO_BUCKET_SLOTS 4
+
+/**
+ * Number of times an insert kicks an entry out of its bucket before putting it in the stash.
+ */
+#define CUCKOO_MAX_KICKS 500
+
+/**
+ * Number of entries that can be kept in the stash when their buckets are full.
+ */
+#define CUCKOO_STASH_SIZE 8
+
+/**
+ * A bucket of the cuckoo table. Slots with EMPTY_KEY are free.
+ */
+typedef struct
+{
+    _Alignas(CUCKOO_BUCKET_SLOTS * sizeof(int)) int keys[CUCKOO_BUCKET_SLOTS];
+} cuckoo_bucket;
+
+/**
+ * Bucketized cuckoo hash table.
+ * Every value lives in one of two buckets, the one from hash1 or the one from hash1 + hash2,
+ * or in the small stash if both were full when it was added.
+ * A lookup therefore reads at most two buckets, plus the stash when it is not empty.
+ */
+typedef struct
+{
+    size_t capacity;
+    size_t bucket_count;
+    size_t entries;
+    size_t collisions;
+    cuckoo_bucket *buckets;
+    bool contains_empty_key;
+    int stash[CUCKOO_STASH_SIZE];
+    size_t stash_length;
+    // State of the xorshift generator picking which entry to kick out
+    uint32_t random;
+
+    hash_context hash_ctx;
+} cuckoo_table;
+
+/**
+ * Creates a cuckoo table with at least the specified number of slots, rounded up to a power of two.
+ * The buckets are allocated like the slots in hash_table_create.
+ */
+cuckoo_table *cuckoo_table_create(size_t min_capacity, const memory_options *memory)
+{
+    cuckoo_table *table = calloc(1, sizeof(cuckoo_table));
+    table->capacity = pow2_round(min_capacity < CUCKOO_BUCKET_SLOTS * 2 ? CUCKOO_BUCKET_SLOTS * 2 : min_capacity);
+    table->bucket_count = table->capacity / CUCKOO_BUCKET_SLOTS;
+    table->buckets = large_alloc(table->bucket_count * sizeof(cuckoo_bucket), memory);
+    for (size_t i = 0; i < table->bucket_count; i++)
+    {
+        for (int k = 0; k < CUCKOO_BUCKET_SLOTS; k++)
+        {
+            table->buckets[i].keys[k] = EMPTY_KEY;
+        }
+    }
+    table->random = 2463534242u;
+    table->hash_ctx = hash_context_create(table->bucket_count, pow2_round_exponent(table->bucket_count));
+    return table;
+}
+
+void cuckoo_table_free(cuckoo_table *table)
+{
+    large_free(table->buckets);
+    free(table);
+}
+
+/**
+ * Returns the first bucket of the value.
+ */
+size_t cuckoo_bucket1(cuckoo_table *table, int v)
+{
+    return hash1(table->hash_ctx, v) & (table->bucket_count - 1);
+}
+
+/**
+ * Returns the second bucket of the value. hash2 is odd, so it always differs from the first.
+ */
+size_t cuckoo_bucket2(cuckoo_table *table, int v)
+{
+    return (hash1(table->hash_ctx, v) + hash2(table->hash_ctx, v)) & (table->bucket_count - 1);
+}
+
+/**
+ * Stores the value in a free slot of the bucket. Returns false if the bucket is full.
+ */
+bool cuckoo_bucket_insert(cuckoo_bucket *bucket, int v)
+{
+    for (int k = 0; k < CUCKOO_BUCKET_SLOTS; k++)
+    {
+        if (bucket->keys[k] == EMPTY_KEY)
+        {
+            bucket->keys[k] = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cuckoo_bucket_contains(const cuckoo_bucket *bucket, int v)
+{
+    bool found = false;
+    for (int k = 0; k < CUCKOO_BUCKET_SLOTS; k++)
+    {
+        found |= bucket->keys[k] == v;
+    }
+    return found;
+}
+
+/**
+ * Adds the value to the cuckoo table.
+ * If both its buckets are full, a random entry of one of them is kicked out to its other bucket,
+ * and so on until an entry finds room. After CUCKOO_MAX_KICKS the homeless entry goes to the stash.
+ * Returns the number of entries that were kicked out.
+ */
+size_t cuckoo_table_add(cuckoo_table *table, int v)
+{
+    size_t colls = 0;
+
+    if (v == EMPTY_KEY)
+    {
+        if (!table->contains_empty_key)
+        {
+            table->contains_empty_key = true;
+            table->entries++;
+        }
+        return colls;
+    }
+
+    size_t bucket = cuckoo_bucket1(table, v);
+    if (cuckoo_bucket_insert(&table->buckets[bucket], v))
+    {
+        table->entries++;
+        return colls;
+    }
+    bucket = cuckoo_bucket2(table, v);
+    for (int kick = 0; kick < CUCKOO_MAX_KICKS; kick++)
+    {
+        if (cuckoo_bucket_insert(&table->buckets[bucket], v))
+        {
+            table->entries++;
+            table->collisions += colls;
+            return colls;
+        }
+
+        table->random ^= table->random << 13;
+        table->random ^= table->random >> 17;
+        table->random ^= table->random << 5;
+        int *victim = &table->buckets[bucket].keys[table->random % CUCKOO_BUCKET_SLOTS];
+        int kicked = *victim;
+        *victim = v;
+        v = kicked;
+        colls++;
+
+        size_t first = cuckoo_bucket1(table, v);
+        bucket = first == bucket ? cuckoo_bucket2(table, v) : first;
+    }
+
+    table->collisions += colls;
+    if (table->stash_length == CUCKOO_STASH_SIZE)
+    {
+        // The entry still homeless is dropped, and the cell reports it as values that did not fit
+        return colls;
+    }
+    table->stash[table->stash_length++] = v;
+    table->entries++;
+    return colls;
+}
+
+size_t cuckoo_table_add_all(cuckoo_table *table, const int *values, size_t values_length)
+{
+    size_t col = 0;
+    for (size_t i = 0; i < values_length; i++)
+    {
+        col += cuckoo_table_add(table, values[i]);
+    }
+    return col;
+}
+
+/**
+ * Returns the number of buckets a lookup of the value reads, counting the stash as one.
+ * That is 1 or 2 for values in the buckets and 3 for values in the stash or not in the table.
+ */
+size_t cuckoo_table_probe_length(cuckoo_table *table, int v)
+{
+    if (v == EMPTY_KEY)
+    {
+        return 1;
+    }
+    if (cuckoo_bucket_contains(&table->buckets[cuckoo_bucket1(table, v)], v))
+    {
+        return 1;
+    }
+    if (cuckoo_bucket_contains(&table->buckets[cuckoo_bucket2(table, v)], v))
+    {
+        return 2;
+    }
+    return table->stash_length ? 3 : 2;
+}
+
+bool cuckoo_table_stash_contains(cuckoo_table *table, int v)
+{
+    for (size_t i = 0; i < table->stash_length; i++)
+    {
+        if (table->stash[i] == v)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns true if the value is in the table. Reads at most two buckets, and the stash when it is used.
+ */
+bool cuckoo_table_lookup(cuckoo_table *table, int v)
+{
+    if (v == EMPTY_KEY)
+    {
+        return table->contains_empty_key;
+    }
+    return cuckoo_bucket_contains(&table->buckets[cuckoo_bucket1(table, v)], v) ||
+           cuckoo_bucket_contains(&table->buckets[cuckoo_bucket2(table, v)], v) ||
+           cuckoo_table_stash_contains(table, v);
+}
+
+/**
+ * Looks up n values, like hash_table_lookup_batch.
+ * Both buckets of every value in a group are prefetched before any of them are read.
+ */
+void cuckoo_table_lookup_batch(cuckoo_table *table, const int keys[], size_t n, bool *found_out)
+{
+    size_t first[LOOKUP_BATCH_SIZE];
+    size_t second[LOOKUP_BATCH_SIZE];
+
+    for (size_t base = 0; base < n; base += LOOKUP_BATCH_SIZE)
+    {
+        size_t count = n - base < LOOKUP_BATCH_SIZE ? n - base : LOOKUP_BATCH_SIZE;
+        for (size_t i = 0; i < count; i++)
+        {
+            first[i] = cuckoo_bucket1(table, keys[base + i]);
+            second[i] = cuckoo_bucket2(table, keys[base + i]);
+            __builtin_prefetch(&table->buckets[first[i]]);
+            __builtin_prefetch(&table->buckets[second[i]]);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            int v = keys[base + i];
+            if (v == EMPTY_KEY)
+            {
+                found_out[base + i] = table->contains_empty_key;
+                continue;
+            }
+            found_out[base + i] = cuckoo_bucket_contains(&table->buckets[first[i]], v) ||
+                                  cuckoo_bucket_contains(&table->buckets[second[i]], v) ||
+                                  cuckoo_table_stash_contains(table, v);
+        }
+    }
+}
+
+/**
+ * Returns the number of bytes used for the buckets and stash of the table.
+ */
+size_t cuckoo_table_slot_bytes(cuckoo_table *table)
+{
+    return table->bucket_count * sizeof(cuckoo_bucket) + sizeof(table->stash);
+}
+
+/**
+ * Typed tables over the benchmark keys, one per key type. The values are the int keys.
+ * The int keys are widened bijectively, so the wider keys are unique too.
+ */
+#define TYPED_KEY_U32(v) ((uint32_t)(v))
+#define TYPED_KEY_U64(v) ((uint64_t)(uint32_t)(v) * 0x9e3779b97f4a7c15ull)
+
+TYPED_TABLE_FIXED_KEY(bytes16_key, 16)
+
+bytes16_key typed_key_bytes16(int v)
+{
+    uint64_t words[2] = {TYPED_KEY_U64(v), ~(uint64_t)(uint32_t)v};
+    bytes16_key key;
+    memcpy(key.bytes, words, sizeof(key.bytes));
+    return key;
+}
+
+TYPED_TABLE_DEFINE(u32_table, uint32_t, int, TYPED_HASH_SCALAR, TYPED_EQUAL_SCALAR)
+TYPED_TABLE_DEFINE(u64_table, uint64_t, int, TYPED_HASH_SCALAR, TYPED_EQUAL_SCALAR)
+TYPED_TABLE_DEFINE(bytes16_table, bytes16_key, int, bytes16_key_hash, bytes16_key_equal)
+
+/**
+ * Number of shards in a sharded counter. Threads beyond this share shards.
+ */
+#define COUNTER_SHARDS 64
+#define CACHE_LINE_SIZE 64
+
+/**
+ * A counter shard on a cache line of its own, so threads updating different shards do not contend.
+ */
+typedef struct
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t value;
+} counter_shard;
+
+/**
+ * A counter split into shards. Every thread adds to its own shard, and reading sums all of them.
+ */
+typedef struct
+{
+    counter_shard shards[COUNTER_SHARDS];
+} sharded_counter;
+
+/**
+ * Gets the counter shard of the calling thread. Shards are handed out to threads in turn.
+ */
+int thread_shard()
+{
+    static atomic_int next_shard = 0;
+    static _Thread_local int shard = -1;
+    if (shard < 0)
+    {
+        shard = atomic_fetch_add(&next_shard, 1) % COUNTER_SHARDS;
+    }
+    return shard;
+}
+
+void sharded_counter_add(sharded_counter *counter, size_t amount)
+{
+    atomic_fetch_add_explicit(&counter->shards[thread_shard()].value, amount, memory_order_relaxed);
+}
+
+size_t sharded_counter_sum(sharded_counter *counter)
+{
+    size_t sum = 0;
+    for (int i = 0; i < COUNTER_SHARDS; i++)
+    {
+        sum += atomic_load_explicit(&counter->shards[i].value, memory_order_relaxed);
+    }
+    return sum;
+}
+
+/**
+ * Struct for the concurrent Hash Table.
+ * 
+ * Every slot is a single 64-bit word, which is 0 when the slot is empty and
+ * CONCURRENT_SLOT_USED | value otherwise. A slot is claimed by a compare-and-swap
+ * from 0, so it goes from empty to its final value in one step and never changes again.
+ * That makes inserts lock-free, and lookups wait-free since they never retry.
+ */
+typedef struct
+{
+    size_t capacity_pow2exp;
+    size_t capacity;
+    _Atomic uint64_t *slots;
+    sharded_counter entries;
+    sharded_counter collisions;
+
+    probe_func *probe;
+    hash_context hash_ctx;
+} concurrent_hash_table;
+
+const uint64_t CONCURRENT_SLOT_USED = (uint64_t)1 << 32;
+
+/**
+ * Creates a concurrent hashtable with a specified capacity and probe function.
+ * The capacity is rounded and the slots are allocated the same way as for hash_table_create.
+ */
+concurrent_hash_table *concurrent_hash_table_create(size_t min_capacity, probe_func *probe, const memory_options *memory)
+{
+    concurrent_hash_table *table = aligned_alloc(CACHE_LINE_SIZE, sizeof(concurrent_hash_table));
+    memset(table, 0, sizeof(concurrent_hash_table));
+    table->capacity_pow2exp = pow2_round_exponent(min_capacity);
+    table->capacity = pow2_round(min_capacity);
+    table->slots = large_alloc(table->capacity * sizeof(uint64_t), memory);
+    table->probe = probe;
+    table->hash_ctx = hash_context_create(table->capacity, table->capacity_pow2exp);
+    return table;
+}
+
+void concurrent_hash_table_free(concurrent_hash_table *table)
+{
+    large_free((void *)table->slots);
+    free(table);
+}
+
+/**
+* Adds a value to the concurrent hashtable. Safe to call from any number of threads.
+* If another thread claims a slot first, probing continues with the next one,
+* unless the other thread inserted the same value.
+* Returns number of collisions until value got placed.
+*/
+size_t concurrent_hash_table_add(concurrent_hash_table *table, int v)
+{
+    probe_context ctx = (probe_context){
+        .hash_ctx = &table->hash_ctx,
+        .key = v,
+        .capacity = table->capacity,
+        .hash1 = hash1(table->hash_ctx, v),
+        .hash2 = 0,
+    };
+    const uint64_t word = CONCURRENT_SLOT_USED | (uint32_t)v;
+
+    size_t colls = 0;
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        _Atomic uint64_t *slot = &table->slots[table->probe(&ctx, i)];
+        uint64_t current = atomic_load_explicit(slot, memory_order_acquire);
+        if (current == 0 && atomic_compare_exchange_strong_explicit(slot, &current, word, memory_order_acq_rel, memory_order_acquire))
+        {
+            sharded_counter_add(&table->entries, 1);
+            sharded_counter_add(&table->collisions, colls);
+            return colls;
+        }
+        if (current == word)
+        {
+            break;
+        }
+        colls++;
+    }
+    if (colls == table->capacity)
+    {
+        fprintf(stderr, "Table full, laddies/lassies!\n");
+    }
+    sharded_counter_add(&table->collisions, colls);
+    return colls;
+}
+
+/**
+* Looks up a value in the concurrent hashtable. Safe to call from any number of threads,
+* also while other threads are adding values. Finishes in at most capacity probes.
+*/
+bool concurrent_hash_table_lookup(concurrent_hash_table *table, int v)
+{
+    probe_context ctx = (probe_context){
+        .hash_ctx = &table->hash_ctx,
+        .key = v,
+        .capacity = table->capacity,
+        .hash1 = hash1(table->hash_ctx, v),
+        .hash2 = 0,
+    };
+    const uint64_t word = CONCURRENT_SLOT_USED | (uint32_t)v;
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        uint64_t current = atomic_load_explicit(&table->slots[table->probe(&ctx, i)], memory_order_acquire);
+        if (current == 0)
+        {
+            return false;
+        }
+        if (current == word)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t concurrent_hash_table_entries(concurrent_hash_table *table)
+{
+    return sharded_counter_sum(&table->entries);
+}
+
+size_t concurrent_hash_table_collisions(concurrent_hash_table *table)
+{
+    return sharded_counter_sum(&table->collisions);
+}
+
+/**
+ * The table a benchmarked strategy runs on.
+ */
+typedef enum
+{
+    // hash_table, with the probe and layout of the cell
+    TABLE_OPEN,
+    // cuckoo_table, the probe and layout are not used
+    TABLE_CUCKOO,
+    // Typed tables from typed_table.h, the probe and layout are not used
+    TABLE_TYPED_U32,
+    TABLE_TYPED_U64,
+    TABLE_TYPED_BYTES16,
+} table_kind;
+
+/**
+ * A probe function that can be selected in the benchmark.
+ */
+typedef struct
+{
+    const char *name;
+    probe_func *probe;
+    // Insert loop specialized for this probe function
+    size_t (*add_all)(hash_table *table, int *values, size_t values_length);
+    // The insert loop moves entries, so there is no indirect variant through the probe function
+    bool displaces;
+    table_kind table;
+    // Single value add and remove for the mixed workload, NULL if the strategy cannot remove
+    size_t (*add)(hash_table *table, int v);
+    bool (*remove)(hash_table *table, int v);
+} probe_type;
+
+/**
+ * A slot layout that can be selected in the benchmark.
+ */
+typedef struct
+{
+    const char *name;
+    slot_layout layout;
+} layout_type;
+
+const layout_type layout_types[] = {
+    {"padded", LAYOUT_PADDED},
+    {"sentinel", LAYOUT_SENTINEL},
+    {"bitmap", LAYOUT_BITMAP}};
+const int layout_types_length = sizeof(layout_types) / sizeof(layout_types[0]);
+
+const probe_type probe_types[] = {
+    {.name = "linear", .probe = &probe_linear, .add_all = &hash_table_add_all_linear, .add = &hash_table_add, .remove = &hash_table_remove},
+    {.name = "quadratic", .probe = &probe_quadratic, .add_all = &hash_table_add_all_quadratic, .add = &hash_table_add, .remove = &hash_table_remove},
+    {.name = "double-hash", .probe = &probe_doublehash, .add_all = &hash_table_add_all_doublehash, .add = &hash_table_add, .remove = &hash_table_remove},
+    {.name = "robin-hood", .probe = &probe_linear, .add_all = &hash_table_add_all_robin_hood, .displaces = true, .add = &hash_table_add_robin_hood, .remove = &hash_table_remove_robin_hood},
+    {.name = "hopscotch", .probe = &probe_linear, .add_all = &hash_table_add_all_hopscotch, .displaces = true},
+    {.name = "cuckoo", .displaces = true, .table = TABLE_CUCKOO},
+    {.name = "typed-u32", .table = TABLE_TYPED_U32},
+    {.name = "typed-u64", .table = TABLE_TYPED_U64},
+    {.name = "typed-bytes16", .table = TABLE_TYPED_BYTES16}};
+const int probe_types_length = sizeof(probe_types) / sizeof(probe_types[0]);
+
+const float fill_ratios[] = {0.5, 0.8, 0.9, 0.99, 1.0};
+const int fill_ratios_length = sizeof(fill_ratios) / sizeof(fill_ratios[0]);
+
+const int column_size = 11;
+const float CONCURRENT_FILL_RATIO = 0.9;
+const float WORKLOAD_FILL_RATIO = 0.8;
+
+/**
+ * Number of phases the mixed workload is reported in, to show how it changes as tombstones build up.
+ */
+#define WORKLOAD_PHASES 10
+
+/**
+ * The operations of the mixed workload.
+ */
+typedef enum
+{
+    OP_HIT,
+    OP_MISS,
+    OP_DELETE,
+    OP_INSERT,
+    OP_KINDS,
+} workload_op;
+
+/**
+ * How the benchmark matrix is printed.
+ */
+typedef enum
+{
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON,
+} output_format;
+
+const char *const output_format_names[] = {"text", "csv", "json"};
+
+/**
+ * Options for the benchmark, set from the command line.
+ */
+typedef struct
+{
+    int table_bound;
+    bool lookups;
+    int jobs;
+    int concurrent_threads;
+    // Index of the layout to benchmark, or -1 for all of them.
+    int layout;
+    // Insert through the table's probe pointer instead of the specialized loops.
+    bool indirect;
+    // Run the mixed workload instead of the matrix, with the percentage of each workload_op.
+    bool mixed;
+    int workload[OP_KINDS];
+    size_t ops;
+    // Seed of the generated key set, and where generated key sets are cached (NULL to not cache)
+    uint64_t seed;
+    const char *key_cache;
+    // Distribution of the keys. If all_distributions is set, the matrix and the sweep run with every one.
+    key_distribution distribution;
+    bool all_distributions;
+    // Table memory. If all_pages is set, the matrix runs with every page size.
+    memory_options memory;
+    bool all_pages;
+    // Number of times every insert pass is repeated, and whether hardware counters are read
+    int trials;
+    bool counters;
+    // How the matrix is printed, and the matrix printed with --format=json to compare against (NULL to not compare)
+    output_format format;
+    const char *baseline_path;
+    // Untimed insert passes before the trials, and whether the table memory is faulted in before every pass
+    int warmup;
+    bool prefault;
+    // Run the matrix for every capacity from 2^sweep_from to 2^sweep_to instead (sweep_to is 0 for no sweep)
+    int sweep_from;
+    int sweep_to;
+    // Test the hash functions instead of timing the tables
+    bool hash_quality;
+} benchmark_options;
+
+/**
+ * A single cell in the benchmark matrix: one probe function at one fill ratio, on one key distribution.
+ */
+typedef struct
+{
+    const probe_type *probe;
+    const layout_type *layout;
+    page_mode pages;
+    key_distribution keys;
+    float fill_ratio;
+} benchmark_cell;
+
+/**
+ * Most trials a cell can be repeated for.
+ */
+#define MAX_TRIALS 32
+
+/**
+ * The hardware events counted during the insert pass.
+ */
+typedef enum
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_DTLB_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_KINDS,
+} counter_kind;
+
+const char *const counter_names[COUNTER_KINDS] = {"Cycles", "Instrs", "L1D misses", "LLC misses", "dTLB misses", "Br misses"};
+const char *const counter_keys[COUNTER_KINDS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"};
+
+/**
+ * The perf_event_attr type and config of every counter. The cache counters count read misses.
+ */
+const struct
+{
+    uint32_t type;
+    uint64_t config;
+} counter_events[COUNTER_KINDS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/**
+ * The measurements of a benchmark cell.
+ * The insert time and counters are the medians over the trials; counters are per insert,
+ * and negative if the counter could not be opened.
+ */
+typedef struct
+{
+    bool failed;
+    float load_factor;
+    size_t capacity;
+    size_t entries;
+    size_t collisions;
+    size_t slot_bytes;
+    // Page size the table memory actually got
+    page_mode pages;
+    size_t max_probe;
+    double mean_probe;
+    double time_ms;
+    double time_stddev_ms;
+    double ns_per_op;
+    double counters[COUNTER_KINDS];
+    double lookup_ms;
+    double batch_ms;
+    size_t lookup_found;
+    // Values the table had no room for. The keys are unique, so every value not in entries was dropped.
+    size_t dropped;
+} cell_result;
+
+/**
+ * Gets the elapsed time between start and end in milliseconds.
+ */
+double elapsed_ms(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+/***************************************
+ * Measurement                         *
+ ***************************************/
+
+/**
+ * measurement times repeated trials of an insert pass with CLOCK_MONOTONIC_RAW, which is not
+ * adjusted by NTP, and counts hardware events in them with perf_event_open. Every other interval
+ * in the benchmark is timed with the same clock.
+ * The counters follow the calling thread, so cells running in parallel count only their own work.
+ * A counter that cannot be opened (no PMU, or a strict perf_event_paranoid) has the fd -1.
+ * The warm-up passes are run before the first trial and thrown away.
+ */
+typedef struct
+{
+    int fds[COUNTER_KINDS];
+    int trials;
+    int trial;
+    // Passes left before the trials, which are run the same way but not recorded
+    int warmup;
+    bool failed;
+    struct timespec start;
+    double time_ms[MAX_TRIALS];
+    double counts[COUNTER_KINDS][MAX_TRIALS];
+} measurement;
+
+/**
+ * Opens a counter of the event for the calling thread, counting user space only.
+ * Returns -1 if it is not available.
+ */
+int perf_counter_open(counter_kind kind)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_events[kind].type;
+    attr.config = counter_events[kind].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void measurement_init(measurement *m, const benchmark_options *options)
+{
+    // Cells start their measurements on several --jobs workers at once
+    static atomic_bool warned = false;
+    memset(m, 0, sizeof(*m));
+    m->trials = options->trials;
+    m->warmup = options->warmup;
+    for (int k = 0; k < COUNTER_KINDS; k++)
+    {
+        m->fds[k] = options->counters ? perf_counter_open(k) : -1;
+        if (options->counters && m->fds[k] < 0 && !atomic_exchange(&warned, true))
+        {
+            fprintf(stderr, "NOTE: Could not open the %s counter (%s), it is reported as n/a.\n", counter_names[k], strerror(errno));
+        }
+    }
+}
+
+/**
+ * Starts a trial. Everything between this and measurement_end is measured.
+ */
+void measurement_begin(measurement *m)
+{
+    for (int k = 0; k < COUNTER_KINDS; k++)
+    {
+        if (m->fds[k] >= 0)
+        {
+            ioctl(m->fds[k], PERF_EVENT_IOC_RESET, 0);
+            ioctl(m->fds[k], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    m->failed |= clock_gettime(CLOCK_MONOTONIC_RAW, &m->start) != 0;
+}
+
+void measurement_end(measurement *m)
+{
+    struct timespec end;
+    m->failed |= clock_gettime(CLOCK_MONOTONIC_RAW, &end) != 0;
+    for (int k = 0; k < COUNTER_KINDS; k++)
+    {
+        uint64_t count = 0;
+        if (m->fds[k] >= 0)
+        {
+            ioctl(m->fds[k], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m->fds[k], &count, sizeof(count)) != sizeof(count))
+            {
+                close(m->fds[k]);
+                m->fds[k] = -1;
+            }
+        }
+        m->counts[k][m->trial] = count;
+    }
+    if (m->warmup > 0)
+    {
+        m->warmup--;
+        return;
+    }
+    m->time_ms[m->trial] = elapsed_ms(m->start, end);
+    m->trial++;
+}
+
+/**
+ * Whether the next trial is the last one. Its table is kept for the probe and lookup measurements.
+ */
+bool measurement_last(const measurement *m)
+{
+    return m->warmup == 0 && m->trial + 1 >= m->trials;
+}
+
+int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Gets the median of the values. The values are sorted.
+ */
+double median(double *values, int n)
+{
+    qsort(values, n, sizeof(double), &compare_double);
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/**
+ * Gets the sample standard deviation of the values, 0 for a single value.
+ */
+double standard_deviation(const double *values, int n)
+{
+    if (n < 2)
+    {
+        return 0;
+    }
+    double mean = 0, squares = 0;
+    for (int i = 0; i < n; i++)
+    {
+        mean += values[i];
+    }
+    mean /= n;
+    for (int i = 0; i < n; i++)
+    {
+        squares += (values[i] - mean) * (values[i] - mean);
+    }
+    return sqrt(squares / (n - 1));
+}
+
+/**
+ * Closes the counters and writes the medians of the trials, per operation, to the result.
+ */
+void measurement_finish(measurement *m, size_t ops, cell_result *result)
+{
+    result->failed = m->failed;
+    result->time_stddev_ms = standard_deviation(m->time_ms, m->trial);
+    result->time_ms = median(m->time_ms, m->trial);
+    result->ns_per_op = ops ? result->time_ms * 1000000 / ops : 0;
+    for (int k = 0; k < COUNTER_KINDS; k++)
+    {
+        result->counters[k] = -1;
+        if (m->fds[k] >= 0)
+        {
+            result->counters[k] = ops ? median(m->counts[k], m->trial) / ops : 0;
+            close(m->fds[k]);
+        }
+    }
+}
+
+/**
+ * Runs a benchmark cell on its own cuckoo table, measuring the same as run_cell.
+ */
+cell_result run_cuckoo_cell(const benchmark_cell *cell, const int *values, size_t table_size, const benchmark_options *options)
+{
+    cell_result result = {0};
+    size_t values_length = table_size * cell->fill_ratio;
+    memory_options memory = {cell->pages, options->memory.numa};
+    cuckoo_table *table = NULL;
+
+    measurement m;
+    measurement_init(&m, options);
+    do
+    {
+        if (table)
+        {
+            cuckoo_table_free(table);
+        }
+        table = cuckoo_table_create(options->table_bound, &memory);
+        if (options->prefault)
+        {
+            prefault(table->buckets, table->bucket_count * sizeof(cuckoo_bucket));
+        }
+        measurement_begin(&m);
+        result.collisions = cuckoo_table_add_all(table, values, values_length);
+        measurement_end(&m);
+    } while (m.trial < m.trials);
+    measurement_finish(&m, values_length, &result);
+
+    result.load_factor = (double)table->entries / table->capacity * 100;
+    result.capacity = table->capacity;
+    result.entries = table->entries;
+    result.dropped = values_length - table->entries;
+    result.slot_bytes = cuckoo_table_slot_bytes(table);
+    result.pages = large_pages(table->buckets);
+
+    size_t total_probe = 0;
+    for (size_t k = 0; k < values_length; k++)
+    {
+        size_t probe_length = cuckoo_table_probe_length(table, values[k]);
+        total_probe += probe_length;
+        result.max_probe = probe_length > result.max_probe ? probe_length : result.max_probe;
+    }
+    result.mean_probe = values_length ? (double)total_probe / values_length : 0;
+
+    if (options->lookups)
+    {
+        struct timespec lookup_start, lookup_end, batch_end;
+        bool *found = calloc(values_length, sizeof(bool));
+        size_t lookup_found = 0;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &lookup_start);
+        for (size_t k = 0; k < values_length; k++)
+        {
+            lookup_found += cuckoo_table_lookup(table, values[k]);
+        }
+        clock_gettime(CLOCK_MONOTONIC_RAW, &lookup_end);
+        cuckoo_table_lookup_batch(table, values, values_length, found);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &batch_end);
+
+        size_t batch_found = 0;
+        for (size_t k = 0; k < values_length; k++)
+        {
+            batch_found += found[k];
+        }
+        result.lookup_ms = elapsed_ms(lookup_start, lookup_end);
+        result.batch_ms = elapsed_ms(lookup_end, batch_end);
+        result.lookup_found = lookup_found < batch_found ? lookup_found : batch_found;
+        free(found);
+    }
+
+    cuckoo_table_free(table);
+    return result;
+}
+
+/**
+ * Defines run_<table>_cell, which runs a benchmark cell on a typed table, measuring the same as run_cell.
+ * make_key converts a benchmark key to the key type of the table.
+ * Typed tables are allocated with malloc, so the page size does not apply. The table is created fixed at the
+ * capacity of the other tables, so every fill ratio is measured at the same load as theirs, without a resize.
+ */
+#define TYPED_BENCHMARK_DEFINE(table_name, key_type, make_key)                                                                           \
+    cell_result run_##table_name##_cell(const benchmark_cell *cell, const int *values, size_t table_size, const benchmark_options *options) \
+    {                                                                                                                                    \
+        cell_result result = {0};                                                                                                        \
+        size_t values_length = table_size * cell->fill_ratio;                                                                            \
+        key_type *keys = malloc(values_length * sizeof(key_type));                                                                       \
+        for (size_t k = 0; k < values_length; k++)                                                                                       \
+        {                                                                                                                                \
+            keys[k] = make_key(values[k]);                                                                                               \
+        }                                                                                                                                \
+        table_name *table = NULL;                                                                                                        \
+                                                                                                                                         \
+        measurement m;                                                                                                                   \
+        measurement_init(&m, options);                                                                                                   \
+        do                                                                                                                               \
+        {                                                                                                                                \
+            if (table)                                                                                                                   \
+            {                                                                                                                            \
+                table_name##_free(table);                                                                                                \
+            }                                                                                                                            \
+            table = table_name##_create_fixed(options->table_bound, options->seed);                                                      \
+            measurement_begin(&m);                                                                                                       \
+            for (size_t k = 0; k < values_length; k++)                                                                                   \
+            {                                                                                                                            \
+                table_name##_add(table, keys[k], values[k]);                                                                             \
+            }                                                                                                                            \
+            measurement_end(&m);                                                                                                         \
+        } while (m.trial < m.trials);                                                                                                    \
+        measurement_finish(&m, values_length, &result);                                                                                  \
+                                                                                                                                         \
+        result.load_factor = table_name##_load_factor(table) * 100;                                                                      \
+        result.capacity = table_name##_capacity(table);                                                                                  \
+        result.entries = table_name##_entries(table);                                                                                    \
+        result.dropped = values_length - result.entries;                                                                                 \
+        result.collisions = table_name##_collisions(table);                                                                              \
+        result.slot_bytes = table_name##_bytes(table);                                                                                   \
+        result.pages = PAGES_DEFAULT;                                                                                                    \
+                                                                                                                                         \
+        size_t total_probe = 0;                                                                                                          \
+        for (size_t k = 0; k < values_length; k++)                                                                                       \
+        {                                                                                                                                \
+            size_t probe_length = table_name##_probe_length(table, keys[k]);                                                             \
+            total_probe += probe_length;                                                                                                 \
+            result.max_probe = probe_length > result.max_probe ? probe_length : result.max_probe;                                        \
+        }                                                                                                                                \
+        result.mean_probe = values_length ? (double)total_probe / values_length : 0;                                                     \
+                                                                                                                                         \
+        if (options->lookups)                                                                                                            \
+        {                                                                                                                                \
+            struct timespec lookup_start, lookup_end, batch_end;                                                                         \
+            bool *found = calloc(values_length, sizeof(bool));                                                                           \
+            int *found_values = calloc(values_length, sizeof(int));                                                                      \
+            size_t lookup_found = 0;                                                                                                     \
+            clock_gettime(CLOCK_MONOTONIC_RAW, &lookup_start);                                                                               \
+            for (size_t k = 0; k < values_length; k++)                                                                                   \
+            {                                                                                                                            \
+                int value;                                                                                                               \
+                lookup_found += table_name##_lookup(table, keys[k], &value) && value == values[k];                                       \
+            }                                                                                                                            \
+            clock_gettime(CLOCK_MONOTONIC_RAW, &lookup_end);                                                                                 \
+            table_name##_lookup_batch(table, keys, values_length, found_values, found);                                                  \
+            clock_gettime(CLOCK_MONOTONIC_RAW, &batch_end);                                                                                  \
+                                                                                                                                         \
+            size_t batch_found = 0;                                                                                                      \
+            for (size_t k = 0; k < values_length; k++)                                                                                   \
+            {                                                                                                                            \
+                batch_found += found[k] && found_values[k] == values[k];                                                                 \
+            }                                                                                                                            \
+            result.lookup_ms = elapsed_ms(lookup_start, lookup_end);                                                                     \
+            result.batch_ms = elapsed_ms(lookup_end, batch_end);                                                                         \
+            result.lookup_found = lookup_found < batch_found ? lookup_found : batch_found;                                               \
+            free(found_values);                                                                                                          \
+            free(found);                                                                                                                 \
+        }                                                                                                                                \
+                                                                                                                                         \
+        table_name##_free(table);                                                                                                        \
+        free(keys);                                                                                                                      \
+        return result;                                                                                                                   \
+    }
+
+TYPED_BENCHMARK_DEFINE(u32_table, uint32_t, TYPED_KEY_U32)
+TYPED_BENCHMARK_DEFINE(u64_table, uint64_t, TYPED_KEY_U64)
+TYPED_BENCHMARK_DEFINE(bytes16_table, bytes16_key, typed_key_bytes16)
+
+/**
+ * Whether a cell inserts through the probe pointer. Only the open addressing tables have that variant,
+ * and only for the probes whose insert loop does not move entries.
+ */
+bool cell_indirect(const benchmark_cell *cell, const benchmark_options *options)
+{
+    return options->indirect && cell->probe->table == TABLE_OPEN && !cell->probe->displaces;
+}
+
+/**
+ * Runs a benchmark cell on its own table.
+ * The values array is only read, so cells can run in parallel.
+ */
+cell_result run_cell(const benchmark_cell *cell, const int *values, size_t table_size, const benchmark_options *options)
+{
+    switch (cell->probe->table)
+    {
+    case TABLE_CUCKOO:
+        return run_cuckoo_cell(cell, values, table_size, options);
+    case TABLE_TYPED_U32:
+        return run_u32_table_cell(cell, values, table_size, options);
+    case TABLE_TYPED_U64:
+        return run_u64_table_cell(cell, values, table_size, options);
+    case TABLE_TYPED_BYTES16:
+        return run_bytes16_table_cell(cell, values, table_size, options);
+    default:
+        break;
+    }
+
+    cell_result result = {0};
+    size_t values_length = table_size * cell->fill_ratio;
+    memory_options memory = {cell->pages, options->memory.numa};
+    hash_table *table = NULL;
+
+    measurement m;
+    measurement_init(&m, options);
+    do
+    {
+        if (table)
+        {
+            hash_table_free(table);
+        }
+        table = hash_table_create(options->table_bound, cell->probe->probe, cell->layout->layout, &memory);
+        if (options->prefault)
+        {
+            hash_table_prefault(table);
+        }
+        measurement_begin(&m);
+        if (cell_indirect(cell, options))
+        {
+            result.collisions = hash_table_add_all(table, (int *)values, values_length);
+        }
+        else
+        {
+            result.collisions = cell->probe->add_all(table, (int *)values, values_length);
+        }
+        measurement_end(&m);
+    } while (m.trial < m.trials);
+    measurement_finish(&m, values_length, &result);
+    if (result.failed)
+    {
+        hash_table_free(table);
+        return result;
+    }
+    result.load_factor = get_load_factor(table);
+    result.capacity = table->capacity;
+    result.entries = table->entries;
+    result.dropped = values_length - table->entries;
+    result.slot_bytes = hash_table_slot_bytes(table);
+    result.pages = hash_table_pages(table);
+
+    size_t total_probe = 0;
+    for (size_t k = 0; k < values_length; k++)
+    {
+        size_t probe_length = hash_table_probe_length(table, values[k]);
+        total_probe += probe_length;
+        result.max_probe = probe_length > result.max_probe ? probe_length : result.max_probe;
+    }
+    result.mean_probe = values_length ? (double)total_probe / values_length : 0;
+
+    if (options->lookups)
+    {
+        struct timespec lookup_start, lookup_end, batch_end;
+        bool *found = calloc(values_length, sizeof(bool));
+        size_t lookup_found = 0;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &lookup_start);
+        for (size_t k = 0; k < values_length; k++)
+        {
+            lookup_found += hash_table_lookup(table, values[k]);
+        }
+        clock_gettime(CLOCK_MONOTONIC_RAW, &lookup_end);
+        hash_table_lookup_batch(table, values, values_length, found);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &batch_end);
+
+        size_t batch_found = 0;
+        for (size_t k = 0; k < values_length; k++)
+        {
+            batch_found += found[k];
+        }
+        result.lookup_ms = elapsed_ms(lookup_start, lookup_end);
+        result.batch_ms = elapsed_ms(lookup_end, batch_end);
+        result.lookup_found = lookup_found < batch_found ? lookup_found : batch_found;
+        free(found);
+    }
+
+    hash_table_free(table);
+    return result;
+}
+
+void print_cell_header(const benchmark_cell *cell, const benchmark_options *options)
+{
+    if (cell->probe->table == TABLE_CUCKOO)
+    {
+        printf("Creating tables (load 50%%-100%%) for %s, %d buckets of %d slots per value",
+               cell->probe->name, 2, CUCKOO_BUCKET_SLOTS);
+    }
+    else if (cell->probe->table != TABLE_OPEN)
+    {
+        printf("Creating tables (load 50%%-100%%) for %s, inline keys and values, fixed capacity", cell->probe->name);
+    }
+    else
+    {
+        printf("Creating tables (load 50%%-100%%) for %s, %s layout, %s inserts",
+               cell->probe->name, cell->layout->name, cell_indirect(cell, options) ? "indirect" : "specialized");
+    }
+    printf(", %s pages, %s NUMA placement, %s keys\n", page_mode_names[cell->pages], numa_mode_names[options->memory.numa],
+           key_distribution_names[cell->keys]);
+    printf("Insert time and counters are medians of %d trials, counters are per insert\n", options->trials);
+    printf(
+        "%*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s",
+        column_size, "Load-factor",
+        column_size, "Capacity",
+        column_size, "Entries",
+        column_size, "Collisions",
+        column_size, "Time (ms)",
+        column_size, "Stddev (ms)",
+        column_size, "ns/insert",
+        column_size, "Bytes/entry",
+        column_size, "Max probe",
+        column_size, "Mean probe");
+    if (options->counters)
+    {
+        for (int k = 0; k < COUNTER_KINDS; k++)
+        {
+            printf(" | %*s", column_size, counter_names[k]);
+        }
+    }
+    if (options->lookups)
+    {
+        printf(" | %*s | %*s", column_size, "Lookup (ms)", column_size, "Batch (ms)");
+    }
+    printf("\n");
+}
+
+void print_cell_row(const benchmark_cell *cell, const cell_result *result, const benchmark_options *options)
+{
+    printf("%*.0f%% | %*lu | %*lu | %*lu | %*.3f | %*.3f | %*.2f | %*.2f | %*lu | %*.2f",
+           column_size - 1, result->load_factor,
+           column_size, result->capacity,
+           column_size, result->entries,
+           column_size, result->collisions,
+           column_size, result->time_ms,
+           column_size, result->time_stddev_ms,
+           column_size, result->ns_per_op,
+           column_size, (double)result->slot_bytes / result->entries,
+           column_size, result->max_probe,
+           column_size, result->mean_probe);
+    if (options->counters)
+    {
+        for (int k = 0; k < COUNTER_KINDS; k++)
+        {
+            if (result->counters[k] < 0)
+            {
+                printf(" | %*s", column_size, "n/a");
+            }
+            else
+            {
+                printf(" | %*.3f", column_size, result->counters[k]);
+            }
+        }
+    }
+    if (options->lookups)
+    {
+        printf(" | %*.3f | %*.3f",
+               column_size, result->lookup_ms,
+               column_size, result->batch_ms);
+        if (result->lookup_found != result->entries)
+        {
+            printf(" (!MISSING! %lu/%lu found)", result->lookup_found, result->entries);
+        }
+    }
+    if (result->pages != cell->pages)
+    {
+        printf(" (only %s pages)", page_mode_names[result->pages]);
+    }
+    if (result->dropped > 0)
+    {
+        printf(" (!DROPPED! %zu of %zu values did not fit)", result->dropped, result->dropped + result->entries);
+    }
+    printf("\n");
+}
+
+
+/**
+ * Gets the name of the cell's layout, or "none" if its table does not use one.
+ */
+const char *cell_layout_name(const benchmark_cell *cell)
+{
+    return cell->probe->table == TABLE_OPEN ? cell->layout->name : "none";
+}
+
+const char *cell_dispatch_name(const benchmark_cell *cell, const benchmark_options *options)
+{
+    return cell_indirect(cell, options) ? "indirect" : "specialized";
+}
+
+/**
+ * Prints the column names of the CSV output. Every measurement has a column, also those that
+ * were not taken, so the columns are the same for every run.
+ */
+void print_csv_header()
+{
+    printf("probe,layout,dispatch,pages,numa,fill_ratio,load_factor,capacity,entries,collisions,"
+           "time_ms,time_stddev_ms,trials,ns_per_insert,bytes_per_entry,max_probe,mean_probe");
+    for (int k = 0; k < COUNTER_KINDS; k++)
+    {
+        printf(",%s", counter_keys[k]);
+    }
+    printf(",lookup_ms,batch_ms,lookup_found,ns_per_lookup,keys,dropped\n");
+}
+
+/**
+ * Prints a measurement, or the missing value if it was not taken.
+ */
+void print_optional(double value, bool taken, const char *missing)
+{
+    if (taken)
+    {
+        printf("%.6g", value);
+    }
+    else
+    {
+        printf("%s", missing);
+    }
+}
+
+/**
+ * Prints the separator and key before a value of a cell. The first value has none.
+ */
+void print_field_key(const char *key, bool json)
+{
+    printf(json ? ", \"%s\": " : ",", key);
+}
+
+void print_field_string(const char *value, bool json)
+{
+    printf(json ? "\"%s\"" : "%s", value);
+}
+
+/**
+ * Prints a cell as a CSV line (json = false) or as a JSON object, with missing values as null.
+ */
+void print_cell_fields(const benchmark_cell *cell, const cell_result *result, const benchmark_options *options, bool json)
+{
+    const char *missing = json ? "null" : "";
+    printf("%s", json ? "{\"probe\": " : "");
+    print_field_string(cell->probe->name, json);
+    print_field_key("layout", json);
+    print_field_string(cell_layout_name(cell), json);
+    print_field_key("dispatch", json);
+    print_field_string(cell_dispatch_name(cell, options), json);
+    print_field_key("pages", json);
+    print_field_string(page_mode_names[result->pages], json);
+    print_field_key("numa", json);
+    print_field_string(numa_mode_names[options->memory.numa], json);
+    print_field_key("fill_ratio", json);
+    printf("%.6g", cell->fill_ratio);
+    print_field_key("load_factor", json);
+    printf("%.6g", result->load_factor);
+    print_field_key("capacity", json);
+    printf("%zu", result->capacity);
+    print_field_key("entries", json);
+    printf("%zu", result->entries);
+    print_field_key("collisions", json);
+    printf("%zu", result->collisions);
+    print_field_key("time_ms", json);
+    printf("%.6g", result->time_ms);
+    print_field_key("time_stddev_ms", json);
+    printf("%.6g", result->time_stddev_ms);
+    print_field_key("trials", json);
+    printf("%d", options->trials);
+    print_field_key("ns_per_insert", json);
+    printf("%.6g", result->ns_per_op);
+    print_field_key("bytes_per_entry", json);
+    print_optional((double)result->slot_bytes / result->entries, result->entries > 0, missing);
+    print_field_key("max_probe", json);
+    printf("%zu", result->max_probe);
+    print_field_key("mean_probe", json);
+    printf("%.6g", result->mean_probe);
+    for (int k = 0; k < COUNTER_KINDS; k++)
+    {
+        print_field_key(counter_keys[k], json);
+        print_optional(result->counters[k], options->counters && result->counters[k] >= 0, missing);
+    }
+    print_field_key("lookup_ms", json);
+    print_optional(result->lookup_ms, options->lookups, missing);
+    print_field_key("batch_ms", json);
+    print_optional(result->batch_ms, options->lookups, missing);
+    print_field_key("lookup_found", json);
+    print_optional(result->lookup_found, options->lookups, missing);
+    print_field_key("ns_per_lookup", json);
+    print_optional(result->lookup_ms * 1000000 / result->entries, options->lookups && result->entries > 0, missing);
+    print_field_key("keys", json);
+    print_field_string(key_distribution_names[cell->keys], json);
+    print_field_key("dropped", json);
+    printf("%zu", result->dropped);
+    printf("%s", json ? "}" : "\n");
+}
+
+/***************************************
+ * Baseline comparison                 *
+ ***************************************/
+
+/**
+ * Longest name a baseline field can have, with its terminator.
+ */
+#define BASELINE_NAME_SIZE 32
+
+/**
+ * A cell of a baseline written with --format=json. Only what identifies the cell and its insert time is kept.
+ */
+typedef struct
+{
+    char probe[BASELINE_NAME_SIZE];
+    char layout[BASELINE_NAME_SIZE];
+    char dispatch[BASELINE_NAME_SIZE];
+    char pages[BASELINE_NAME_SIZE];
+    char keys[BASELINE_NAME_SIZE];
+    size_t capacity;
+    double fill_ratio;
+    double time_ms;
+    double time_stddev_ms;
+    int trials;
+} baseline_cell;
+
+/**
+ * A slowdown is only a regression if it is at least this large, so measurements with a tiny
+ * standard deviation do not flag noise.
+ */
+#define REGRESSION_MIN_CHANGE 0.02
+
+void skip_space(const char **p)
+{
+    while (**p == ' ' || **p == '\n' || **p == '\r' || **p == '\t')
+    {
+        (*p)++;
+    }
+}
+
+/**
+ * Parses a JSON string into the buffer, truncating it to fit. Escaped characters are kept as they are.
+ */
+bool parse_json_string(const char **p, char *buffer, size_t buffer_size)
+{
+    size_t length = 0;
+    if (**p != '"')
+    {
+        return false;
+    }
+    for ((*p)++; **p != '"'; (*p)++)
+    {
+        if (**p == '\0')
+        {
+            return false;
+        }
+        if (**p == '\\' && (*p)[1] != '\0')
+        {
+            (*p)++;
+        }
+        if (length + 1 < buffer_size)
+        {
+            buffer[length++] = **p;
+        }
+    }
+    (*p)++;
+    buffer[length] = '\0';
+    return true;
+}
+
+/**
+ * Parses an array of flat objects with string, number and null members, which is all --format=json writes.
+ * Returns the cells, or NULL if the file cannot be read or parsed.
+ */
+baseline_cell *baseline_load(const char *path, size_t *length)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open the baseline '%s'.\n", path);
+        return NULL;
+    }
+    size_t text_capacity = 1 << 16, text_length = 0, read;
+    char *text = malloc(text_capacity);
+    while ((read = fread(text + text_length, 1, text_capacity - text_length - 1, file)) > 0)
+    {
+        text_length += read;
+        if (text_length + 1 == text_capacity)
+        {
+            text_capacity *= 2;
+            text = realloc(text, text_capacity);
+        }
+    }
+    text[text_length] = '\0';
+    fclose(file);
+
+    size_t cells_capacity = 64;
+    baseline_cell *cells = malloc(cells_capacity * sizeof(baseline_cell));
+    *length = 0;
+    const char *p = text;
+    skip_space(&p);
+    bool ok = *p++ == '[';
+    skip_space(&p);
+    while (ok && *p != ']')
+    {
+        if (*length == cells_capacity)
+        {
+            cells_capacity *= 2;
+            cells = realloc(cells, cells_capacity * sizeof(baseline_cell));
+        }
+        baseline_cell *cell = &cells[(*length)++];
+        *cell = (baseline_cell){.trials = 1};
+
+        ok = *p++ == '{';
+        skip_space(&p);
+        while (ok && *p != '}')
+        {
+            char key[64], value[BASELINE_NAME_SIZE];
+            ok = parse_json_string(&p, key, sizeof(key));
+            skip_space(&p);
+            ok = ok && *p++ == ':';
+            skip_space(&p);
+            if (!ok)
+            {
+                break;
+            }
+            if (*p == '"')
+            {
+                ok = parse_json_string(&p, value, sizeof(value));
+                char *target = strcmp(key, "probe") == 0      ? cell->probe
+                               : strcmp(key, "layout") == 0   ? cell->layout
+                               : strcmp(key, "dispatch") == 0 ? cell->dispatch
+                               : strcmp(key, "pages") == 0    ? cell->pages
+                               : strcmp(key, "keys") == 0     ? cell->keys
+                                                              : NULL;
+                if (target)
+                {
+                    snprintf(target, BASELINE_NAME_SIZE, "%s", value);
+                }
+            }
+            else if (strncmp(p, "null", 4) == 0)
+            {
+                p += 4;
+            }
+            else
+            {
+                char *end;
+                double number = strtod(p, &end);
+                ok = end != p;
+                p = end;
+                if (strcmp(key, "fill_ratio") == 0)
+                {
+                    cell->fill_ratio = number;
+                }
+                else if (strcmp(key, "capacity") == 0)
+                {
+                    cell->capacity = number;
+                }
+                else if (strcmp(key, "time_ms") == 0)
+                {
+                    cell->time_ms = number;
+                }
+                else if (strcmp(key, "time_stddev_ms") == 0)
+                {
+                    cell->time_stddev_ms = number;
+                }
+                else if (strcmp(key, "trials") == 0)
+                {
+                    cell->trials = number;
+                }
+            }
+            skip_space(&p);
+            if (*p == ',')
+            {
+                p++;
+                skip_space(&p);
+            }
+        }
+        ok = ok && *p++ == '}';
+        skip_space(&p);
+        if (*p == ',')
+        {
+            p++;
+            skip_space(&p);
+        }
+    }
+    free(text);
+    if (!ok)
+    {
+        fprintf(stderr, "Could not parse the baseline '%s', it must be written with --format=json.\n", path);
+        free(cells);
+        return NULL;
+    }
+    return cells;
+}
+
+/**
+ * Finds the baseline cell measuring the same as the cell, or returns NULL.
+ * The capacities must match too, so a baseline taken at another size is never compared.
+ * Baselines written before the key distributions existed measured uniform keys.
+ */
+const baseline_cell *baseline_find(const baseline_cell *baseline, size_t baseline_length, const benchmark_cell *cell,
+                                   const cell_result *result, const benchmark_options *options)
+{
+    for (size_t i = 0; i < baseline_length; i++)
+    {
+        const baseline_cell *b = &baseline[i];
+        const char *keys = b->keys[0] ? b->keys : key_distribution_names[KEYS_UNIFORM];
+        if (strcmp(b->probe, cell->probe->name) == 0 && strcmp(keys, key_distribution_names[cell->keys]) == 0 && strcmp(b->layout, cell_layout_name(cell)) == 0 &&
+            strcmp(b->dispatch, cell_dispatch_name(cell, options)) == 0 && strcmp(b->pages, page_mode_names[result->pages]) == 0 &&
+            b->capacity == result->capacity && fabs(b->fill_ratio - cell->fill_ratio) < 1e-4)
+        {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Gets the two-sided 95% critical value of Student's t distribution with df degrees of freedom.
+ */
+double t_critical_95(double df)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    const int table_length = sizeof(table) / sizeof(table[0]);
+    if (df < 1)
+    {
+        return table[0];
+    }
+    if (df < table_length + 1)
+    {
+        return table[(int)df - 1];
+    }
+    // Past the table, the value at the lower end of each range, so the test stays conservative
+    return df < 40 ? 2.042 : df < 60 ? 2.021 : df < 120 ? 2.000 : 1.980;
+}
+
+/**
+ * Compares the insert time of every cell with the baseline using Welch's t-test, taking the reported
+ * medians as the means. A cell regressed if it is significantly slower and by at least REGRESSION_MIN_CHANGE.
+ * Prints a report to stdout in the text format, and to stderr otherwise.
+ * Returns false if any cell regressed.
+ */
+bool compare_baseline(const benchmark_cell *cells, const cell_result *results, size_t cells_length, const benchmark_options *options)
+{
+    size_t baseline_length;
+    baseline_cell *baseline = baseline_load(options->baseline_path, &baseline_length);
+    if (!baseline)
+    {
+        return false;
+    }
+
+    FILE *out = options->format == FORMAT_TEXT ? stdout : stderr;
+    size_t regressions = 0, improvements = 0;
+    fprintf(out, "Comparison with %s (insert time, 95%% confidence, at least %.0f%% change)\n",
+            options->baseline_path, REGRESSION_MIN_CHANGE * 100);
+    fprintf(out, "%*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s\n",
+            column_size + 2, "Probe",
+            column_size, "Layout",
+            column_size, "Keys",
+            column_size, "Load",
+            column_size, "Base (ms)",
+            column_size, "Now (ms)",
+            column_size, "Change",
+            column_size, "t",
+            column_size, "Result");
+    for (size_t i = 0; i < cells_length; i++)
+    {
+        const benchmark_cell *cell = &cells[i];
+        const cell_result *result = &results[i];
+        const baseline_cell *b = baseline_find(baseline, baseline_length, cell, result, options);
+        fprintf(out, "%*s | %*s | %*s | %*.0f%%", column_size + 2, cell->probe->name, column_size, cell_layout_name(cell),
+                column_size, key_distribution_names[cell->keys], column_size - 1, cell->fill_ratio * 100);
+        if (!b || b->time_ms <= 0)
+        {
+            fprintf(out, " | %*s | %*.3f | %*s | %*s | %*s\n", column_size, "-", column_size, result->time_ms,
+                    column_size, "-", column_size, "-", column_size, "no baseline");
+            continue;
+        }
+
+        double change = (result->time_ms - b->time_ms) / b->time_ms;
+        if (b->trials < 2)
+        {
+            // One trial has no standard deviation, so no change can be told apart from noise
+            fprintf(out, " | %*.3f | %*.3f | %*.1f%% | %*s | %*s\n", column_size, b->time_ms, column_size, result->time_ms,
+                    column_size - 1, change * 100, column_size, "-", column_size, "few trials");
+            continue;
+        }
+        double v1 = b->time_stddev_ms * b->time_stddev_ms / b->trials;
+        double v2 = result->time_stddev_ms * result->time_stddev_ms / options->trials;
+        double se = sqrt(v1 + v2);
+        double t = se > 0 ? (result->time_ms - b->time_ms) / se : (change > 0 ? INFINITY : -INFINITY);
+        // Welch-Satterthwaite degrees of freedom
+        double df = 1;
+        if (v1 + v2 > 0 && b->trials > 1 && options->trials > 1)
+        {
+            df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (b->trials - 1) + v2 * v2 / (options->trials - 1));
+        }
+        bool significant = fabs(t) >= t_critical_95(df) && fabs(change) >= REGRESSION_MIN_CHANGE;
+        const char *verdict = !significant ? "same" : change > 0 ? "REGRESSION" : "improved";
+        regressions += significant && change > 0;
+        improvements += significant && change < 0;
+        fprintf(out, " | %*.3f | %*.3f | %*.1f%% | %*.2f | %*s\n", column_size, b->time_ms, column_size, result->time_ms,
+                column_size - 1, change * 100, column_size, t, column_size, verdict);
+    }
+    fprintf(out, "%zu regressions, %zu improvements in %zu cells\n\n", regressions, improvements, cells_length);
+    free(baseline);
+    return regressions == 0;
+}
+
+/**
+ * Pins the calling thread to the CPU. Does nothing if the CPU is negative.
+ */
+void pin_thread(int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+}
+
+/**
+ * benchmark_pool runs the cells of the benchmark matrix on a number of worker threads.
+ * Workers take the next cell from a shared counter and mark it as done when its result is ready,
+ * so the main thread can print the rows in matrix order while other cells are still running.
+ */
+typedef struct
+{
+    const benchmark_cell *cells;
+    cell_result *results;
+    bool *done;
+    size_t cells_length;
+    atomic_size_t next;
+
+    // The keys of every distribution in the matrix, by key_distribution
+    int *const *key_sets;
+    size_t table_size;
+    const benchmark_options *options;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cell_done;
+} benchmark_pool;
+
+typedef struct
+{
+    benchmark_pool *pool;
+    pthread_t thread;
+    int cpu;
+} benchmark_worker;
+
+void *benchmark_worker_run(void *arg)
+{
+    benchmark_worker *worker = (benchmark_worker *)arg;
+    benchmark_pool *pool = worker->pool;
+
+    // Pin the worker, so its timings are not disturbed by migrating between cores.
+    pin_thread(worker->cpu);
+
+    for (;;)
+    {
+        size_t i = atomic_fetch_add(&pool->next, 1);
+        if (i >= pool->cells_length)
+        {
+            break;
+        }
+        cell_result result = run_cell(&pool->cells[i], pool->key_sets[pool->cells[i].keys], pool->table_size, pool->options);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->results[i] = result;
+        pool->done[i] = true;
+        pthread_cond_broadcast(&pool->cell_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Gets the CPUs the process is allowed to run on. Returns the number of CPUs written to cpus.
+ */
+int allowed_cpus(int *cpus, int max)
+{
+    cpu_set_t set;
+    int count = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        return 0;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+        {
+            cpus[count++] = cpu;
+        }
+    }
+    return count;
+}
+
+/**
+ * Runs every cell of the matrix on the specified number of jobs, and prints the results in matrix order.
+ * key_sets has the keys of every key_distribution a cell uses.
+ * Returns false if a cell failed.
+ */
+bool run_matrix(const benchmark_cell *cells, size_t cells_length, int *const key_sets[], size_t table_size, const benchmark_options *options)
+{
+    benchmark_pool pool = {
+        .cells = cells,
+        .results = calloc(cells_length, sizeof(cell_result)),
+        .done = calloc(cells_length, sizeof(bool)),
+        .cells_length = cells_length,
+        .key_sets = key_sets,
+        .table_size = table_size,
+        .options = options,
+    };
+    atomic_init(&pool.next, 0);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cell_done, NULL);
+
+    int jobs = options->jobs;
+    int *cpus = calloc(jobs, sizeof(int));
+    int cpus_length = allowed_cpus(cpus, jobs);
+    if (cpus_length < jobs)
+    {
+        fprintf(stderr, "Only %d cores available for %d jobs, some jobs will share a core.\n", cpus_length, jobs);
+    }
+    benchmark_worker *workers = calloc(jobs, sizeof(benchmark_worker));
+    for (int i = 0; i < jobs; i++)
+    {
+        workers[i].pool = &pool;
+        workers[i].cpu = cpus_length > 0 ? cpus[i % cpus_length] : -1;
+        pthread_create(&workers[i].thread, NULL, &benchmark_worker_run, &workers[i]);
+    }
+
+    bool ok = true;
+    if (options->format == FORMAT_CSV)
+    {
+        print_csv_header();
+    }
+    else if (options->format == FORMAT_JSON)
+    {
+        printf("[");
+    }
+    for (size_t i = 0; i < cells_length; i++)
+    {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.done[i])
+        {
+            pthread_cond_wait(&pool.cell_done, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        if (options->format != FORMAT_TEXT)
+        {
+            if (pool.results[i].failed)
+            {
+                fprintf(stderr, "Time failure\n");
+                ok = false;
+                break;
+            }
+            printf("%s", options->format == FORMAT_JSON ? (i == 0 ? "\n  " : ",\n  ") : "");
+            print_cell_fields(&cells[i], &pool.results[i], options, options->format == FORMAT_JSON);
+            fflush(stdout);
+            continue;
+        }
+
+        bool first_of_group = i == 0 || cells[i].probe != cells[i - 1].probe || cells[i].layout != cells[i - 1].layout ||
+                              cells[i].pages != cells[i - 1].pages || cells[i].keys != cells[i - 1].keys;
+        bool last_of_group = i + 1 == cells_length || cells[i + 1].probe != cells[i].probe || cells[i + 1].layout != cells[i].layout ||
+                             cells[i + 1].pages != cells[i].pages || cells[i + 1].keys != cells[i].keys;
+        if (first_of_group)
+        {
+            print_cell_header(&cells[i], options);
+        }
+        if (pool.results[i].failed)
+        {
+            printf("Time failure");
+            ok = false;
+            break;
+        }
+        print_cell_row(&cells[i], &pool.results[i], options);
+        fflush(stdout);
+        if (last_of_group)
+        {
+            printf("\n");
+        }
+    }
+
+    if (options->format == FORMAT_JSON)
+    {
+        printf("\n]\n");
+    }
+
+    for (int i = 0; i < jobs; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+    if (ok && options->baseline_path)
+    {
+        ok = compare_baseline(cells, pool.results, cells_length, options);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.cell_done);
+    free(workers);
+    free(cpus);
+    free(pool.results);
+    free(pool.done);
+    return ok;
+}
+
+/**
+ * Prints the header of a sweep group: one row per capacity, and the insert and lookup times at every fill ratio.
+ */
+void print_sweep_header(const benchmark_cell *cell, const benchmark_options *options)
+{
+    printf("Sweeping capacities 2^%d to 2^%d for %s", options->sweep_from, options->sweep_to, cell->probe->name);
+    if (cell->probe->table == TABLE_OPEN)
+    {
+        printf(", %s layout", cell->layout->name);
+    }
+    printf(", %s pages, %s NUMA placement, %s keys\n", page_mode_names[cell->pages], numa_mode_names[options->memory.numa],
+           key_distribution_names[cell->keys]);
+    printf("ns per insert (median of %d trials, warm-up passes: %d, table memory faulted in first) and ns per lookup\n",
+           options->trials, options->warmup);
+    printf("%*s | %*s", column_size, "Capacity", column_size, "Table (KiB)");
+    for (int j = 0; j < fill_ratios_length; j++)
+    {
+        char insert[32], lookup[32];
+        snprintf(insert, sizeof(insert), "ins@%.0f%%", fill_ratios[j] * 100);
+        snprintf(lookup, sizeof(lookup), "look@%.0f%%", fill_ratios[j] * 100);
+        printf(" | %*s | %*s", column_size, insert, column_size, lookup);
+    }
+    printf("\n");
+}
+
+/**
+ * Runs the matrix cells of every open-addressing and cuckoo table at every capacity from 2^sweep_from to 2^sweep_to,
+ * to show where throughput drops as the table outgrows each cache level.
+ * The cells run one at a time, so a table never shares the caches with another cell's table.
+ * key_sets has 2^sweep_to keys of every distribution swept; every capacity uses a prefix of them, except for the
+ * adversarial keys, which only collide at the capacity they are chosen for and are chosen again for every capacity.
+ * Typed tables grow while they are filled, so their memory cannot be faulted in up front and they are left out.
+ * Returns false if a cell failed.
+ */
+bool run_sweep(int *const key_sets[], const benchmark_options *options)
+{
+    const int first_layout = options->layout < 0 ? 0 : options->layout;
+    const int layouts_length = options->layout < 0 ? layout_types_length : 1;
+    const int first_keys = options->all_distributions ? 0 : options->distribution;
+    const int last_keys = options->all_distributions ? KEY_DISTRIBUTIONS - 1 : options->distribution;
+    benchmark_options cell_options = *options;
+    cell_options.lookups = true;
+    cell_options.prefault = true;
+
+    bool ok = true;
+    bool first_record = true;
+    if (options->format == FORMAT_CSV)
+    {
+        print_csv_header();
+    }
+    else if (options->format == FORMAT_JSON)
+    {
+        printf("[");
+    }
+    for (int keys = first_keys; keys <= last_keys && ok; keys++)
+    {
+        for (int l = first_layout; l < first_layout + layouts_length && ok; l++)
+        {
+            for (int i = 0; i < probe_types_length && ok; i++)
+            {
+                if ((probe_types[i].table != TABLE_OPEN && probe_types[i].table != TABLE_CUCKOO) ||
+                    (probe_types[i].table != TABLE_OPEN && l != first_layout))
+                {
+                    continue;
+                }
+                benchmark_cell cell = {
+                    .probe = &probe_types[i],
+                    .layout = &layout_types[l],
+                    .pages = options->memory.pages,
+                    .keys = keys,
+                };
+                if (options->format == FORMAT_TEXT)
+                {
+                    print_sweep_header(&cell, options);
+                }
+                for (int exponent = options->sweep_from; exponent <= options->sweep_to && ok; exponent++)
+                {
+                    // pow2_round moves an exact power of two up to the next one, so ask for one less
+                    size_t table_size = (size_t)1 << exponent;
+                    cell_options.table_bound = (int)table_size - 1;
+                    int *values = key_sets[keys];
+                    if (keys == KEYS_ADVERSARIAL && exponent < options->sweep_to)
+                    {
+                        values = create_key_set(keys, table_size, table_size, options->seed, NULL);
+                        ok = values != NULL;
+                        if (!ok)
+                        {
+                            break;
+                        }
+                    }
+                    if (options->format == FORMAT_TEXT)
+                    {
+                        printf("%*zu |", column_size, table_size);
+                    }
+                    for (int j = 0; j < fill_ratios_length; j++)
+                    {
+                        cell.fill_ratio = fill_ratios[j];
+                        cell_result result = run_cell(&cell, values, table_size, &cell_options);
+                        if (result.failed)
+                        {
+                            fprintf(stderr, "Time failure\n");
+                            ok = false;
+                            break;
+                        }
+                        if (options->format != FORMAT_TEXT)
+                        {
+                            printf("%s", options->format == FORMAT_JSON ? (first_record ? "\n  " : ",\n  ") : "");
+                            print_cell_fields(&cell, &result, &cell_options, options->format == FORMAT_JSON);
+                            first_record = false;
+                            continue;
+                        }
+                        if (j == 0)
+                        {
+                            printf(" %*.1f |", column_size, result.slot_bytes / 1024.0);
+                        }
+                        printf(" %*.2f | %*.2f%s", column_size, result.ns_per_op,
+                               column_size, result.entries ? result.lookup_ms * 1000000 / result.entries : 0,
+                               j + 1 < fill_ratios_length ? " |" : "");
+                    }
+                    if (values != key_sets[keys])
+                    {
+                        free(values);
+                    }
+                    if (options->format == FORMAT_TEXT)
+                    {
+                        printf("\n");
+                    }
+                    fflush(stdout);
+                }
+                if (options->format == FORMAT_TEXT)
+                {
+                    printf("\n");
+                }
+            }
+        }
+    }
+    if (options->format == FORMAT_JSON)
+    {
+        printf("\n]\n");
+    }
+    return ok;
+}
+
+/**
+ * Most buckets the hash quality test counts. Bigger tables are binned by the top bits of their slot index.
+ */
+#define HASH_QUALITY_MAX_BIN_BITS 24
+/**
+ * Keys flipped bit by bit for the avalanche test.
+ */
+#define AVALANCHE_SAMPLES 4096
+/**
+ * A bucket occupancy is skewed if its chi-square is this many standard deviations above what a random
+ * function gives. Less even than random is not a problem; multiplicative hashing of sequential keys is.
+ */
+#define HASH_QUALITY_MAX_Z 4.0
+/**
+ * The wide test hashes 64 bit keys for a table of 2^HASH_QUALITY_WIDE_EXPONENT slots, to cover capacities
+ * above 2^32 without allocating one.
+ */
+#define HASH_QUALITY_WIDE_EXPONENT 40
+
+/**
+ * The bucket occupancy of some keys under hash1, measured against n keys thrown at random.
+ */
+typedef struct
+{
+    size_t bins;
+    double chi_square_df;
+    double z;
+    uint32_t max_bucket;
+    double empty_ratio;
+} bucket_occupancy;
+
+/**
+ * Counts how many of the keys hash1 puts in every bucket of a table with 2^exponent slots. With more than
+ * 2^HASH_QUALITY_MAX_BIN_BITS slots, a bucket is a range of slots sharing the top bits of the index.
+ * Hashes the first length keys, or the first length keys of the seeded 64 bit key set if keys is NULL.
+ */
+bucket_occupancy hash1_occupancy(const int *keys, size_t length, int exponent, uint64_t seed)
+{
+    const int bin_bits = exponent < HASH_QUALITY_MAX_BIN_BITS ? exponent : HASH_QUALITY_MAX_BIN_BITS;
+    const size_t bins = (size_t)1 << bin_bits;
+    const hash_context ctx = hash_context_create((size_t)1 << exponent, exponent);
+    uint32_t *counts = calloc(bins, sizeof(uint32_t));
+    for (size_t i = 0; i < length; i++)
+    {
+        uint64_t key = keys ? (uint64_t)keys[i] : unique_key64(i, seed);
+        // A table of one slot still shifts one bit in, see hash_context_create
+        counts[hash1(ctx, key) >> (exponent - bin_bits) & (bins - 1)]++;
+    }
+
+    bucket_occupancy occupancy = {.bins = bins};
+    const double expected = (double)length / bins;
+    double chi_square = 0;
+    size_t empty = 0;
+    for (size_t b = 0; b < bins; b++)
+    {
+        chi_square += (counts[b] - expected) * (counts[b] - expected) / expected;
+        empty += counts[b] == 0;
+        if (counts[b] > occupancy.max_bucket)
+        {
+            occupancy.max_bucket = counts[b];
+        }
+    }
+    free(counts);
+    const double df = bins > 1 ? bins - 1 : 1;
+    occupancy.chi_square_df = chi_square / df;
+    occupancy.z = (chi_square - df) / sqrt(2 * df);
+    occupancy.empty_ratio = (double)empty / bins;
+    return occupancy;
+}
+
+/**
+ * The avalanche of a hash: how far the chance that flipping an input bit flips an output bit is from 1/2,
+ * on average and for the worst pair of bits.
+ */
+typedef struct
+{
+    double mean_bias;
+    double max_bias;
+} avalanche;
+
+/**
+ * Measures the avalanche of hash1 (second = false) or hash2 over the 64 input bits and the capacity_pow2exp
+ * output bits, on the first AVALANCHE_SAMPLES keys. The lowest bit of hash2 is always set, so it is not counted.
+ */
+avalanche measure_avalanche(const int *keys, size_t length, hash_context ctx, bool second)
+{
+    const int samples = length < AVALANCHE_SAMPLES ? length : AVALANCHE_SAMPLES;
+    const int first_bit = second ? 1 : 0;
+    const int output_bits = ctx.capacity_pow2exp;
+    avalanche result = {0};
+    if (samples == 0 || output_bits <= first_bit)
+    {
+        return result;
+    }
+    uint32_t *flips = calloc(output_bits, sizeof(uint32_t));
+    for (int input = 0; input < 64; input++)
+    {
+        memset(flips, 0, output_bits * sizeof(uint32_t));
+        for (int s = 0; s < samples; s++)
+        {
+            uint64_t key = (uint64_t)keys[s];
+            uint64_t flipped = key ^ (uint64_t)1 << input;
+            size_t diff = second ? hash2(ctx, key) ^ hash2(ctx, flipped) : hash1(ctx, key) ^ hash1(ctx, flipped);
+            for (int output = first_bit; output < output_bits; output++)
+            {
+                flips[output] += diff >> output & 1;
+            }
+        }
+        for (int output = first_bit; output < output_bits; output++)
+        {
+            double bias = fabs((double)flips[output] / samples - 0.5);
+            result.mean_bias += bias;
+            result.max_bias = bias > result.max_bias ? bias : result.max_bias;
+        }
+    }
+    result.mean_bias /= 64.0 * (output_bits - first_bit);
+    free(flips);
+    return result;
+}
+
+/**
+ * Tests how evenly hash1 spreads the keys over the buckets at every fill ratio of the matrix, with a
+ * chi-square test of the bucket occupancy, and how well hash1 and hash2 avalanche. Also tests hash1 on
+ * 64 bit keys at a capacity above 2^32.
+ * key_sets has table_size keys of every distribution tested.
+ * Returns false if the buckets of any fill ratio are skewed.
+ */
+bool run_hash_quality(int *const key_sets[], size_t table_size, const benchmark_options *options)
+{
+    const int first_keys = options->all_distributions ? 0 : options->distribution;
+    const int last_keys = options->all_distributions ? KEY_DISTRIBUTIONS - 1 : options->distribution;
+    const int exponent = pow2_round_exponent(table_size - 1);
+    const hash_context ctx = hash_context_create(table_size, exponent);
+    bool ok = true;
+
+    for (int keys = first_keys; keys <= last_keys; keys++)
+    {
+        printf("Bucket occupancy of hash1 at capacity %zu, %s keys (skewed if z > %.0f)\n",
+               table_size, key_distribution_names[keys], HASH_QUALITY_MAX_Z);
+        printf("%*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s | %*s\n",
+               column_size, "Load-factor",
+               column_size, "Keys",
+               column_size, "Buckets",
+               column_size, "Chi2/df",
+               column_size, "z",
+               column_size, "Max bucket",
+               column_size, "Empty",
+               column_size, "Random empty",
+               column_size, "Result");
+        for (int j = 0; j < fill_ratios_length; j++)
+        {
+            size_t length = table_size * fill_ratios[j];
+            bucket_occupancy occupancy = hash1_occupancy(key_sets[keys], length, exponent, options->seed);
+            bool skewed = occupancy.z > HASH_QUALITY_MAX_Z;
+            ok = ok && !skewed;
+            printf("%*.0f%% | %*zu | %*zu | %*.3f | %*.2f | %*u | %*.2f%% | %*.2f%% | %*s\n",
+                   column_size - 1, fill_ratios[j] * 100,
+                   column_size, length,
+                   column_size, occupancy.bins,
+                   column_size, occupancy.chi_square_df,
+                   column_size, occupancy.z,
+                   column_size, occupancy.max_bucket,
+                   column_size - 1, occupancy.empty_ratio * 100,
+                   column_size - 1, exp(-(double)length / occupancy.bins) * 100,
+                   column_size, skewed ? "SKEWED" : "ok");
+        }
+        avalanche first = measure_avalanche(key_sets[keys], table_size, ctx, false);
+        avalanche second = measure_avalanche(key_sets[keys], table_size, ctx, true);
+        printf("Avalanche (bias from 1/2 of an output bit flipping with an input bit): "
+               "hash1 mean %.3f max %.3f, hash2 mean %.3f max %.3f\n\n",
+               first.mean_bias, first.max_bias, second.mean_bias, second.max_bias);
+    }
+
+    // Four keys per bucket keep the test quick
+    const size_t wide_length = ((size_t)1 << HASH_QUALITY_MAX_BIN_BITS) * 4;
+    bucket_occupancy wide = hash1_occupancy(NULL, wide_length, HASH_QUALITY_WIDE_EXPONENT, options->seed);
+    bool skewed = wide.z > HASH_QUALITY_MAX_Z;
+    ok = ok && !skewed;
+    printf("Capacity 2^%d, %zu 64 bit keys in %zu buckets of the top index bits: chi2/df %.3f, z %.2f, %s\n",
+           HASH_QUALITY_WIDE_EXPONENT, wide_length, wide.bins, wide.chi_square_df, wide.z, skewed ? "SKEWED" : "ok");
+    return ok;
+}
+
+/**
+ * A thread in the concurrent benchmark. It inserts its slice of the values,
+ * waits for everyone else to finish, and then looks up its slice again.
+ * Every worker takes its own timestamps, so a descheduled main thread does not skew them.
+ */
+typedef struct
+{
+    concurrent_hash_table *table;
+    const int *values;
+    size_t begin;
+    size_t end;
+    size_t found;
+    int cpu;
+    pthread_barrier_t *barrier;
+    pthread_t thread;
+    // Start and end of the insert phase and of the lookup phase.
+    struct timespec started[2];
+    struct timespec finished[2];
+} concurrent_worker;
+
+enum
+{
+    PHASE_INSERT,
+    PHASE_LOOKUP,
+};
+
+void *concurrent_worker_run(void *arg)
+{
+    concurrent_worker *worker = (concurrent_worker *)arg;
+    pin_thread(worker->cpu);
+
+    pthread_barrier_wait(worker->barrier);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &worker->started[PHASE_INSERT]);
+    for (size_t i = worker->begin; i < worker->end; i++)
+    {
+        concurrent_hash_table_add(worker->table, worker->values[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &worker->finished[PHASE_INSERT]);
+    pthread_barrier_wait(worker->barrier);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &worker->started[PHASE_LOOKUP]);
+    for (size_t i = worker->begin; i < worker->end; i++)
+    {
+        worker->found += concurrent_hash_table_lookup(worker->table, worker->values[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &worker->finished[PHASE_LOOKUP]);
+    return NULL;
+}
+
+/**
+ * Gets the time from the earliest start to the latest end of the phase among the workers, in milliseconds.
+ */
+double workers_span_ms(const concurrent_worker *workers, int threads, int phase)
+{
+    struct timespec start = workers[0].started[phase];
+    struct timespec end = workers[0].finished[phase];
+    for (int t = 1; t < threads; t++)
+    {
+        if (elapsed_ms(workers[t].started[phase], start) > 0)
+        {
+            start = workers[t].started[phase];
+        }
+        if (elapsed_ms(end, workers[t].finished[phase]) > 0)
+        {
+            end = workers[t].finished[phase];
+        }
+    }
+    return elapsed_ms(start, end);
+}
+
+/**
+ * Fills a concurrent table from 1 up to the configured number of threads for every probe function,
+ * and prints how inserts and lookups scale with the number of threads.
+ */
+void run_concurrent(const int *values, size_t table_size, const benchmark_options *options)
+{
+    const int max_threads = options->concurrent_threads;
+    const size_t values_length = table_size * CONCURRENT_FILL_RATIO;
+    int *cpus = calloc(max_threads, sizeof(int));
+    int cpus_length = allowed_cpus(cpus, max_threads);
+    concurrent_worker *workers = calloc(max_threads, sizeof(concurrent_worker));
+
+    for (int i = 0; i < probe_types_length; i++)
+    {
+        // The lock-free table only places values along a probe sequence
+        if (probe_types[i].displaces || probe_types[i].table != TABLE_OPEN)
+        {
+            continue;
+        }
+        printf("Concurrent inserts (load %.0f%%) for %s\n", CONCURRENT_FILL_RATIO * 100, probe_types[i].name);
+        printf(
+            "%*s | %*s | %*s | %*s | %*s | %*s | %*s\n",
+            column_size, "Threads",
+            column_size, "Entries",
+            column_size, "Collisions",
+            column_size, "Insert (ms)",
+            column_size, "Lookup (ms)",
+            column_size, "Mops/s",
+            column_size, "Speedup");
+
+        double single_thread_ms = 0;
+        for (int threads = 1; threads <= max_threads; threads = threads * 2 > max_threads && threads < max_threads ? max_threads : threads * 2)
+        {
+            concurrent_hash_table *table = concurrent_hash_table_create(options->table_bound, probe_types[i].probe, &options->memory);
+            pthread_barrier_t barrier;
+            pthread_barrier_init(&barrier, NULL, threads + 1);
+
+            for (int t = 0; t < threads; t++)
+            {
+                workers[t] = (concurrent_worker){
+                    .table = table,
+                    .values = values,
+                    .begin = values_length * t / threads,
+                    .end = values_length * (t + 1) / threads,
+                    .found = 0,
+                    .cpu = cpus_length > 0 ? cpus[t % cpus_length] : -1,
+                    .barrier = &barrier,
+                };
+                pthread_create(&workers[t].thread, NULL, &concurrent_worker_run, &workers[t]);
+            }
+
+            pthread_barrier_wait(&barrier);
+            pthread_barrier_wait(&barrier);
+            size_t found = 0;
+            for (int t = 0; t < threads; t++)
+            {
+                pthread_join(workers[t].thread, NULL);
+                found += workers[t].found;
+            }
+
+            double insert_ms = workers_span_ms(workers, threads, PHASE_INSERT);
+            double lookup_ms = workers_span_ms(workers, threads, PHASE_LOOKUP);
+            if (threads == 1)
+            {
+                single_thread_ms = insert_ms;
+            }
+            size_t entries = concurrent_hash_table_entries(table);
+            printf("%*d | %*lu | %*lu | %*.3f | %*.3f | %*.2f | %*.2fx",
+                   column_size, threads,
+                   column_size, entries,
+                   column_size, concurrent_hash_table_collisions(table),
+                   column_size, insert_ms,
+                   column_size, lookup_ms,
+                   column_size, values_length / insert_ms / 1000.0,
+                   column_size - 1, single_thread_ms / insert_ms);
+            if (found != entries || entries != values_length)
+            {
+                printf(" (!MISSING! %lu/%lu found)", found, values_length);
+            }
+            printf("\n");
+
+            pthread_barrier_destroy(&barrier);
+            concurrent_hash_table_free(table);
+        }
+        printf("\n");
+    }
+
+    if (cpus_length < max_threads)
+    {
+        printf("NOTE: Only %d cores available, runs with more threads share cores.\n", cpus_length);
+    }
+    free(workers);
+    free(cpus);
+}
+
+int compare_latency(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Sorts the latencies and prints the throughput and the p50, p99 and p999 latency of the operations.
+ */
+void print_workload_row(const char *phase, uint32_t *latencies, size_t ops, double ms, const hash_table *table)
+{
+    qsort(latencies, ops, sizeof(uint32_t), compare_latency);
+    printf("%*s | %*.0f | %*u | %*u | %*u | %*lu | %*lu\n",
+           column_size, phase,
+           column_size, ops / ms * 1000,
+           column_size, latencies[(size_t)((ops - 1) * 0.5)],
+           column_size, latencies[(size_t)((ops - 1) * 0.99)],
+           column_size, latencies[(size_t)((ops - 1) * 0.999)],
+           column_size, table->entries,
+           column_size, table->tombstones);
+}
+
+/**
+ * Fills a table to WORKLOAD_FILL_RATIO for every probe function that can remove values,
+ * then runs a random mix of hits, misses, deletes and inserts on it.
+ * Every operation is timed on its own, so the reported throughput includes the clock reads.
+ */
+void run_workload(const int *values, size_t table_size, const benchmark_options *options)
+{
+    const layout_type *layout = &layout_types[options->layout < 0 ? 0 : options->layout];
+    const size_t ops = options->ops;
+    const size_t phase_ops = ops / WORKLOAD_PHASES;
+    uint32_t *latencies = malloc(ops * sizeof(uint32_t));
+    int *keys = malloc(table_size * sizeof(int));
+
+    for (int i = 0; i < probe_types_length; i++)
+    {
+        const probe_type *probe = &probe_types[i];
+        if (!probe->remove)
+        {
+            continue;
+        }
+        printf("Mixed workload (load %.0f%%, %d%% hits, %d%% misses, %d%% deletes, %d%% inserts) for %s, %s layout\n",
+               WORKLOAD_FILL_RATIO * 100,
+               options->workload[OP_HIT], options->workload[OP_MISS], options->workload[OP_DELETE], options->workload[OP_INSERT],
+               probe->name, layout->name);
+        printf("%*s | %*s | %*s | %*s | %*s | %*s | %*s\n",
+               column_size, "Phase",
+               column_size, "Ops/s",
+               column_size, "p50 (ns)",
+               column_size, "p99 (ns)",
+               column_size, "p999 (ns)",
+               column_size, "Entries",
+               column_size, "Tombstones");
+
+        // keys[0, present) are in the table, the rest are not
+        memcpy(keys, values, table_size * sizeof(int));
+        size_t present = table_size * WORKLOAD_FILL_RATIO;
+        hash_table *table = hash_table_create(options->table_bound, probe->probe, layout->layout, &options->memory);
+        for (size_t k = 0; k < present; k++)
+        {
+            probe->add(table, keys[k]);
+        }
+
+        uint64_t random = 88172645463325252ull;
+        double total_ms = 0;
+        for (int phase = 0; phase < WORKLOAD_PHASES; phase++)
+        {
+            uint32_t *phase_latencies = &latencies[phase * phase_ops];
+            struct timespec phase_start, phase_end;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &phase_start);
+            for (size_t k = 0; k < phase_ops; k++)
+            {
+                random ^= random << 13;
+                random ^= random >> 7;
+                random ^= random << 17;
+
+                workload_op op = OP_HIT;
+                int roll = random % 100;
+                while (op < OP_INSERT && roll >= options->workload[op])
+                {
+                    roll -= options->workload[op];
+                    op++;
+                }
+                // Keep the operation possible when every key is in the table, or none is
+                bool needs_present = op == OP_HIT || op == OP_DELETE;
+                if (needs_present && present == 0)
+                {
+                    op = OP_MISS;
+                }
+                else if (!needs_present && present == table_size)
+                {
+                    op = OP_HIT;
+                }
+                needs_present = op == OP_HIT || op == OP_DELETE;
+                size_t index = needs_present ? (random >> 32) % present : present + (random >> 32) % (table_size - present);
+                int key = keys[index];
+
+                struct timespec start, end;
+                clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+                switch (op)
+                {
+                case OP_HIT:
+                case OP_MISS:
+                    hash_table_lookup(table, key);
+                    break;
+                case OP_DELETE:
+                    probe->remove(table, key);
+                    break;
+                default:
+                    probe->add(table, key);
+                    break;
+                }
+                clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+                phase_latencies[k] = (end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+
+                // Deleted keys move to the end of the present keys, inserted ones to the end of the missing
+                if (op == OP_DELETE)
+                {
+                    present--;
+                    swap(&keys[index], &keys[present]);
+                }
+                else if (op == OP_INSERT)
+                {
+                    swap(&keys[index], &keys[present]);
+                    present++;
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC_RAW, &phase_end);
+            double ms = elapsed_ms(phase_start, phase_end);
+            total_ms += ms;
+
+            char name[16];
+            snprintf(name, sizeof(name), "%d", phase + 1);
+            print_workload_row(name, phase_latencies, phase_ops, ms, table);
+        }
+        print_workload_row("All", latencies, phase_ops * WORKLOAD_PHASES, total_ms, table);
+        printf("\n");
+        hash_table_free(table);
+    }
+
+    free(keys);
+    free(latencies);
+}
+
+void print_help()
+{
+    printf(
+        "Usage: hashperformance [options] [capacity]\n"
+        "E.g. ./hashperformance --lookups 1000000\n"
+        "\n"
+        "Options:\n"
+        "   --lookups         Also time looking up every inserted value, one at a time and batched\n"
+        "   --jobs=<n>        Run up to n cells of the matrix in parallel, each pinned to its own core (default: 1)\n"
+        "                     NOTE: every running cell has a table of its own, so memory use grows with n\n"
+        "   --layout=<name>   Slot layout: padded, sentinel, bitmap or all (default: padded)\n"
+        "   --dispatch=<name> Insert loop: specialized per probe, or indirect through the probe pointer (default: specialized)\n"
+        "   --concurrent=<n>  Instead of the matrix, fill a lock-free table from 1 up to n threads and report the scaling\n"
+        "   --workload=<h:m:d:i> Instead of the matrix, run a mix of h%% hits, m%% misses, d%% deletes and i%% inserts\n"
+        "                        on a table that starts 80%% full, and report throughput and latency (e.g. 70:20:5:5)\n"
+        "   --ops=<n>         Number of operations in the mixed workload (default: 1000000)\n"
+        "   --seed=<n>        Seed of the generated keys, to repeat a run (default: the current time)\n"
+        "   --key-cache=<dir> Keep generated key sets in the directory, and reuse them when length and seed match\n"
+        "   --keys=<name>     Distribution of the keys: uniform, sequential, strided, zipf, clustered, low-entropy,\n"
+        "                     adversarial (keys sharing the home slots of hash1) or all (default: uniform)\n"
+        "                     NOTE: all keeps a key set per distribution in memory\n"
+        "   --pages=<size>    Pages of the table memory: default, thp, 2m, 1g or all (default: default)\n"
+        "   --numa=<mode>     NUMA placement of the table memory: default, local or interleave (default: default)\n"
+        "   --trials=<n>      Repeat every insert pass n times and report the median and standard deviation (default: 3)\n"
+        "   --counters        Also report cycles, instructions, L1D, LLC and dTLB misses and branch misses per insert\n"
+        "                     NOTE: needs perf_event_open, see /proc/sys/kernel/perf_event_paranoid\n"
+        "   --format=<name>   Print the matrix as text, csv or json (default: text)\n"
+        "   --compare=<file>  Compare the insert times with a matrix printed with --format=json, and fail\n"
+        "                     if any cell is significantly slower. Needs at least 2 trials in both runs\n"
+        "   --warmup=<n>      Untimed insert passes before the trials (default: 0, or 1 with --sweep)\n"
+        "   --sweep=<a>:<b>   Instead of the matrix, time inserts and lookups at every capacity from 2^a to 2^b\n"
+        "                     (e.g. 10:28), with the table memory faulted in before every pass. The capacity is ignored\n"
+        "   --hash-quality    Instead of the matrix, test the bucket occupancy of hash1 at every fill ratio with a chi-square\n"
+        "                     test, and the avalanche of hash1 and hash2. Fails if any occupancy is skewed\n");
+}
+
+/**
+ * Parses the command line into the benchmark options.
+ * Returns false if the arguments are invalid.
+ */
+bool parse_options(int argc, char *const argv[], benchmark_options *options)
+{
+    enum
+    {
+        OPTION_LOOKUPS = 256,
+        OPTION_CONCURRENT,
+        OPTION_LAYOUT,
+        OPTION_DISPATCH,
+        OPTION_WORKLOAD,
+        OPTION_OPS,
+        OPTION_SEED,
+        OPTION_KEY_CACHE,
+        OPTION_KEYS,
+        OPTION_PAGES,
+        OPTION_NUMA,
+        OPTION_TRIALS,
+        OPTION_COUNTERS,
+        OPTION_FORMAT,
+        OPTION_COMPARE,
+        OPTION_WARMUP,
+        OPTION_SWEEP,
+        OPTION_HASH_QUALITY,
+    };
+    const struct option long_options[] = {
+        {"lookups", no_argument, NULL, OPTION_LOOKUPS},
+        {"jobs", required_argument, NULL, 'j'},
+        {"concurrent", required_argument, NULL, OPTION_CONCURRENT},
+        {"layout", required_argument, NULL, OPTION_LAYOUT},
+        {"dispatch", required_argument, NULL, OPTION_DISPATCH},
+        {"workload", required_argument, NULL, OPTION_WORKLOAD},
+        {"ops", required_argument, NULL, OPTION_OPS},
+        {"seed", required_argument, NULL, OPTION_SEED},
+        {"key-cache", required_argument, NULL, OPTION_KEY_CACHE},
+        {"keys", required_argument, NULL, OPTION_KEYS},
+        {"pages", required_argument, NULL, OPTION_PAGES},
+        {"numa", required_argument, NULL, OPTION_NUMA},
+        {"trials", required_argument, NULL, OPTION_TRIALS},
+        {"counters", no_argument, NULL, OPTION_COUNTERS},
+        {"format", required_argument, NULL, OPTION_FORMAT},
+        {"compare", required_argument, NULL, OPTION_COMPARE},
+        {"warmup", required_argument, NULL, OPTION_WARMUP},
+        {"sweep", required_argument, NULL, OPTION_SWEEP},
+        {"hash-quality", no_argument, NULL, OPTION_HASH_QUALITY},
+        {NULL, 0, NULL, 0}};
+
+    *options = (benchmark_options){
+        .table_bound = 10000000,
+        .lookups = false,
+        .jobs = 1,
+        .concurrent_threads = 0,
+        .layout = 0,
+        .indirect = false,
+        .mixed = false,
+        .ops = 1000000,
+        .seed = time(NULL),
+        .key_cache = NULL,
+        .distribution = KEYS_UNIFORM,
+        .all_distributions = false,
+        .memory = {PAGES_DEFAULT, NUMA_DEFAULT},
+        .all_pages = false,
+        .trials = 3,
+        .counters = false,
+        .format = FORMAT_TEXT,
+        .baseline_path = NULL,
+        // Resolved once the options are parsed, since the default depends on --sweep
+        .warmup = -1,
+        .prefault = false,
+        .sweep_from = 0,
+        .sweep_to = 0,
+        .hash_quality = false,
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "j:", long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case OPTION_LOOKUPS:
+            options->lookups = true;
+            break;
+        case 'j':
+            options->jobs = atoi(optarg);
+            if (options->jobs < 1)
+            {
+                fprintf(stderr, "The number of jobs must be at least 1.\n");
+                return false;
+            }
+            break;
+        case OPTION_CONCURRENT:
+            options->concurrent_threads = atoi(optarg);
+            if (options->concurrent_threads < 1)
+            {
+                fprintf(stderr, "The number of threads must be at least 1.\n");
+                return false;
+            }
+            break;
+        case OPTION_LAYOUT:
+            options->layout = -2;
+            if (strcmp(optarg, "all") == 0)
+            {
+                options->layout = -1;
+            }
+            for (int i = 0; i < layout_types_length; i++)
+            {
+                if (strcmp(optarg, layout_types[i].name) == 0)
+                {
+                    options->layout = i;
+                }
+            }
+            if (options->layout == -2)
+            {
+                fprintf(stderr, "Unknown layout '%s'.\n", optarg);
+                return false;
+            }
+            break;
+        case OPTION_DISPATCH:
+            if (strcmp(optarg, "indirect") != 0 && strcmp(optarg, "specialized") != 0)
+            {
+                fprintf(stderr, "Unknown dispatch '%s'.\n", optarg);
+                return false;
+            }
+            options->indirect = strcmp(optarg, "indirect") == 0;
+            break;
+        case OPTION_WORKLOAD:
+        {
+            int *w = options->workload;
+            if (sscanf(optarg, "%d:%d:%d:%d", &w[OP_HIT], &w[OP_MISS], &w[OP_DELETE], &w[OP_INSERT]) != OP_KINDS ||
+                w[OP_HIT] < 0 || w[OP_MISS] < 0 || w[OP_DELETE] < 0 || w[OP_INSERT] < 0 ||
+                w[OP_HIT] + w[OP_MISS] + w[OP_DELETE] + w[OP_INSERT] != 100)
+            {
+                fprintf(stderr, "The workload must be four percentages adding up to 100.\n");
+                return false;
+            }
+            options->mixed = true;
+            break;
+        }
+        case OPTION_TRIALS:
+            options->trials = atoi(optarg);
+            if (options->trials < 1 || options->trials > MAX_TRIALS)
+            {
+                fprintf(stderr, "The number of trials must be from 1 to %d.\n", MAX_TRIALS);
+                return false;
+            }
+            break;
+        case OPTION_COUNTERS:
+            options->counters = true;
+            break;
+        case OPTION_FORMAT:
+        {
+            int format = find_mode_name(output_format_names, sizeof(output_format_names) / sizeof(output_format_names[0]), optarg);
+            if (format < 0)
+            {
+                fprintf(stderr, "Unknown format '%s'.\n", optarg);
+                return false;
+            }
+            options->format = format;
+            break;
+        }
+        case OPTION_COMPARE:
+            options->baseline_path = optarg;
+            break;
+        case OPTION_WARMUP:
+            options->warmup = atoi(optarg);
+            if (options->warmup < 0)
+            {
+                fprintf(stderr, "The number of warm-up passes cannot be negative.\n");
+                return false;
+            }
+            break;
+        case OPTION_SWEEP:
+            if (sscanf(optarg, "%d:%d", &options->sweep_from, &options->sweep_to) != 2 ||
+                options->sweep_from < 4 || options->sweep_to > 30 || options->sweep_from > options->sweep_to)
+            {
+                fprintf(stderr, "The sweep must be two exponents from 4 to 30, the first no larger than the second.\n");
+                return false;
+            }
+            break;
+        case OPTION_HASH_QUALITY:
+            options->hash_quality = true;
+            break;
+        case OPTION_OPS:
+            options->ops = strtoull(optarg, NULL, 10);
+            if (options->ops < WORKLOAD_PHASES)
+            {
+                fprintf(stderr, "The number of operations must be at least %d.\n", WORKLOAD_PHASES);
+                return false;
+            }
+            break;
+        case OPTION_SEED:
+            options->seed = strtoull(optarg, NULL, 10);
+            break;
+        case OPTION_KEY_CACHE:
+            options->key_cache = optarg;
+            break;
+        case OPTION_KEYS:
+        {
+            int keys = find_mode_name(key_distribution_names, KEY_DISTRIBUTIONS, optarg);
+            options->all_distributions = strcmp(optarg, "all") == 0;
+            if (keys < 0 && !options->all_distributions)
+            {
+                fprintf(stderr, "Unknown key distribution '%s'.\n", optarg);
+                return false;
+            }
+            options->distribution = keys < 0 ? KEYS_UNIFORM : keys;
+            break;
+        }
+        case OPTION_PAGES:
+        {
+            int pages = find_mode_name(page_mode_names, sizeof(page_mode_names) / sizeof(page_mode_names[0]), optarg);
+            options->all_pages = strcmp(optarg, "all") == 0;
+            if (pages < 0 && !options->all_pages)
+            {
+                fprintf(stderr, "Unknown page size '%s'.\n", optarg);
+                return false;
+            }
+            options->memory.pages = pages < 0 ? PAGES_DEFAULT : pages;
+            break;
+        }
+        case OPTION_NUMA:
+        {
+            int numa = find_mode_name(numa_mode_names, sizeof(numa_mode_names) / sizeof(numa_mode_names[0]), optarg);
+            if (numa < 0)
+            {
+                fprintf(stderr, "Unknown NUMA placement '%s'.\n", optarg);
+                return false;
+            }
+            options->memory.numa = numa;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (optind < argc) //User can specify capaicity
+    {
+        options->table_bound = atoi(argv[optind]);
+    }
+    if (options->all_distributions && (options->concurrent_threads > 0 || options->mixed))
+    {
+        fprintf(stderr, "Only the matrix, the sweep and the hash quality test can run with every key distribution.\n");
+        return false;
+    }
+    if (options->warmup < 0)
+    {
+        options->warmup = options->sweep_to > 0 ? 1 : 0;
+    }
+    if (options->baseline_path && options->trials < 2)
+    {
+        fprintf(stderr, "Comparing against a baseline needs at least 2 trials.\n");
+        return false;
+    }
+    if (options->sweep_to > 0)
+    {
+        if (options->baseline_path)
+        {
+            fprintf(stderr, "A sweep cannot be compared against a baseline.\n");
+            return false;
+        }
+        // The keys are generated for the largest capacity and every smaller one uses a prefix of them
+        options->table_bound = (1 << options->sweep_to) - 1;
+    }
+    return options->table_bound > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    benchmark_options options;
+    if (!parse_options(argc, argv, &options))
+    {
+        print_help();
+        return 1;
+    }
+    int table_bound = options.table_bound;
+
+    size_t table_size = pow2_round(table_bound);
+
+    const int first_keys = options.all_distributions ? 0 : options.distribution;
+    const int last_keys = options.all_distributions ? KEY_DISTRIBUTIONS - 1 : options.distribution;
+    int *key_sets[KEY_DISTRIBUTIONS] = {NULL};
+    for (int keys = first_keys; keys <= last_keys; keys++)
+    {
+        fprintf(options.format == FORMAT_TEXT ? stdout : stderr, "Generating %zu unique %s numbers (seed %llu)...\n%s",
+                table_size, key_distribution_names[keys], (unsigned long long)options.seed, keys == last_keys ? "\n" : "");
+        key_sets[keys] = create_key_set(keys, table_size, table_size, options.seed, options.key_cache);
+        if (!key_sets[keys])
+        {
+            return 1;
+        }
+    }
+    int *rand_array = key_sets[first_keys];
+
+    if (options.concurrent_threads > 0)
+    {
+        run_concurrent(rand_array, table_size, &options);
+        free(rand_array);
+        return 0;
+    }
+
+    if (options.mixed)
+    {
+        run_workload(rand_array, table_size, &options);
+        free(rand_array);
+        return 0;
+    }
+
+    bool ok;
+    if (options.hash_quality)
+    {
+        ok = run_hash_quality(key_sets, table_size, &options);
+    }
+    else if (options.sweep_to > 0)
+    {
+        ok = run_sweep(key_sets, &options);
+    }
+    else
+    {
+        const int first_layout = options.layout < 0 ? 0 : options.layout;
+        const int layouts_length = options.layout < 0 ? layout_types_length : 1;
+        const int first_pages = options.all_pages ? PAGES_DEFAULT : options.memory.pages;
+        const int last_pages = options.all_pages ? PAGES_HUGE_1G : options.memory.pages;
+        benchmark_cell *cells = calloc((last_keys - first_keys + 1) * (last_pages - first_pages + 1) * layouts_length *
+                                           probe_types_length * fill_ratios_length,
+                                       sizeof(benchmark_cell));
+        size_t cells_length = 0;
+        for (int keys = first_keys; keys <= last_keys; keys++)
+        {
+            for (int pages = first_pages; pages <= last_pages; pages++)
+            {
+                for (int l = first_layout; l < first_layout + layouts_length; l++)
+                {
+                    for (int i = 0; i < probe_types_length; i++)
+                    {
+                        // The cuckoo and typed tables have layouts of their own, so they only need to run once
+                        if (probe_types[i].table != TABLE_OPEN && l != first_layout)
+                        {
+                            continue;
+                        }
+                        for (int j = 0; j < fill_ratios_length; j++)
+                        {
+                            cells[cells_length++] = (benchmark_cell){
+                                .probe = &probe_types[i],
+                                .layout = &layout_types[l],
+                                .pages = pages,
+                                .keys = keys,
+                                .fill_ratio = fill_ratios[j],
+                            };
+                        }
+                    }
+                }
+            }
+        }
+
+        ok = run_matrix(cells, cells_length, key_sets, table_size, &options);
+        free(cells);
+    }
+
+    for (int keys = first_keys; keys <= last_keys; keys++)
+    {
+        free(key_sets[keys]);
+    }
+    return ok ? 0 : -1;
+}
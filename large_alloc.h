@@ -0,0 +1,252 @@
+#ifndef LARGE_ALLOC_H
+#define LARGE_ALLOC_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/***************************************
+ * Large allocations                   *
+ ***************************************/
+
+/*
+ * Memory for big tables, shared by texthashtable and hashperformance: cache-line aligned heap
+ * allocations, or mappings with a page size and NUMA placement. Allocate with large_alloc and
+ * free with large_free.
+ */
+
+/**
+ * Page size used for the memory of big tables.
+ * PAGES_TRANSPARENT asks the kernel for transparent huge pages with madvise.
+ * PAGES_HUGE_2M and PAGES_HUGE_1G map reserved huge pages with MAP_HUGETLB,
+ * and fall back to transparent huge pages when none are reserved.
+ */
+typedef enum
+{
+    PAGES_DEFAULT,
+    PAGES_TRANSPARENT,
+    PAGES_HUGE_2M,
+    PAGES_HUGE_1G,
+} page_mode;
+
+/**
+ * NUMA placement of the memory of big tables.
+ * NUMA_LOCAL places every page on the node of the thread that first touches it,
+ * NUMA_INTERLEAVE spreads the pages round-robin over all online nodes.
+ */
+typedef enum
+{
+    NUMA_DEFAULT,
+    NUMA_LOCAL,
+    NUMA_INTERLEAVE,
+} numa_mode;
+
+typedef struct
+{
+    page_mode pages;
+    numa_mode numa;
+} memory_options;
+
+static const char *const page_mode_names[] = {"default", "thp", "2m", "1g"};
+static const char *const numa_mode_names[] = {"default", "local", "interleave"};
+
+#define HUGE_PAGE_2M ((size_t)2 << 20)
+#define HUGE_PAGE_1G ((size_t)1 << 30)
+
+// Memory policies of the mbind system call, see linux/mempolicy.h
+#define MEMORY_POLICY_INTERLEAVE 3
+#define MEMORY_POLICY_LOCAL 4
+
+/**
+ * Header in front of every large allocation, padded to a cache line so the memory after it stays aligned.
+ */
+typedef struct
+{
+    _Alignas(64) size_t mapped_size;
+    page_mode pages;
+} large_header;
+
+/**
+ * Reads the online NUMA nodes from sysfs into the mask. Returns false if they are unknown.
+ */
+static inline bool numa_online_nodes(unsigned long *mask, size_t mask_bits)
+{
+    FILE *file = fopen("/sys/devices/system/node/online", "r");
+    if (!file)
+    {
+        return false;
+    }
+    memset(mask, 0, mask_bits / CHAR_BIT);
+    unsigned int first, last;
+    int matched;
+    while ((matched = fscanf(file, "%u-%u", &first, &last)) >= 1)
+    {
+        last = matched == 2 ? last : first;
+        for (unsigned int node = first; node <= last && node < mask_bits; node++)
+        {
+            mask[node / (sizeof(long) * CHAR_BIT)] |= 1UL << (node % (sizeof(long) * CHAR_BIT));
+        }
+        if (fgetc(file) != ',')
+        {
+            break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Applies the NUMA placement to a mapping that has not been touched yet.
+ * The placement is only a hint, so failures are reported once and otherwise ignored.
+ */
+static inline void numa_place(void *addr, size_t length, numa_mode numa)
+{
+    static atomic_bool warned = false;
+    unsigned long mask[1024 / (sizeof(long) * CHAR_BIT)];
+    long result = -1;
+    if (numa == NUMA_LOCAL)
+    {
+        result = syscall(SYS_mbind, addr, length, MEMORY_POLICY_LOCAL, NULL, 0, 0);
+    }
+    else if (numa == NUMA_INTERLEAVE && numa_online_nodes(mask, sizeof(mask) * CHAR_BIT))
+    {
+        result = syscall(SYS_mbind, addr, length, MEMORY_POLICY_INTERLEAVE, mask, sizeof(mask) * CHAR_BIT + 1, 0);
+    }
+    if (result != 0 && !atomic_exchange(&warned, true))
+    {
+        fprintf(stderr, "NOTE: Could not apply the %s NUMA placement, using the default.\n", numa_mode_names[numa]);
+    }
+}
+
+/**
+ * Maps anonymous memory of the length aligned to the alignment, by mapping more and unmapping the ends.
+ */
+static inline void *map_aligned(size_t length, size_t alignment)
+{
+    size_t padded = length + alignment;
+    unsigned char *base = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+    unsigned char *aligned = (unsigned char *)(((uintptr_t)base + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (aligned > base)
+    {
+        munmap(base, aligned - base);
+    }
+    munmap(aligned + length, base + padded - (aligned + length));
+    return aligned;
+}
+
+/**
+ * Allocates zeroed memory for a big table with the page size and NUMA placement of the options.
+ * If options is NULL or all default, this is a cache-line aligned heap allocation. Free the memory with large_free.
+ */
+static inline void *large_alloc(size_t size, const memory_options *options)
+{
+    const size_t header_size = sizeof(large_header);
+    large_header *header;
+    if (options == NULL || (options->pages == PAGES_DEFAULT && options->numa == NUMA_DEFAULT))
+    {
+        // calloc only aligns for max_align_t, which would leave the header and the memory after it misaligned
+        size_t length = (header_size + size + header_size - 1) / header_size * header_size;
+        header = aligned_alloc(header_size, length);
+        if (!header)
+        {
+            return NULL;
+        }
+        memset(header, 0, length);
+        header->mapped_size = 0;
+        header->pages = PAGES_DEFAULT;
+        return header + 1;
+    }
+
+    page_mode pages = options->pages;
+    size_t length = 0;
+    void *base = MAP_FAILED;
+    if (pages == PAGES_HUGE_2M || pages == PAGES_HUGE_1G)
+    {
+        size_t page = pages == PAGES_HUGE_1G ? HUGE_PAGE_1G : HUGE_PAGE_2M;
+        int page_flag = (pages == PAGES_HUGE_1G ? 30 : 21) << MAP_HUGE_SHIFT;
+        length = (header_size + size + page - 1) & ~(page - 1);
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_flag, -1, 0);
+        // Without reserved huge pages the kernel can still back the memory with transparent ones
+        pages = base == MAP_FAILED ? PAGES_TRANSPARENT : pages;
+    }
+    if (base == MAP_FAILED)
+    {
+        size_t page = pages == PAGES_TRANSPARENT ? HUGE_PAGE_2M : (size_t)sysconf(_SC_PAGESIZE);
+        length = (header_size + size + page - 1) & ~(page - 1);
+        base = map_aligned(length, page);
+        if (!base)
+        {
+            return NULL;
+        }
+        if (pages == PAGES_TRANSPARENT)
+        {
+            madvise(base, length, MADV_HUGEPAGE);
+        }
+    }
+    if (options->numa != NUMA_DEFAULT)
+    {
+        numa_place(base, length, options->numa);
+    }
+
+    header = base;
+    header->mapped_size = length;
+    header->pages = pages;
+    return header + 1;
+}
+
+/**
+ * Touches every page of the memory, so the page faults are taken now instead of on first use.
+ * Every touched byte is written back unchanged.
+ */
+static inline void prefault(void *ptr, size_t size)
+{
+    volatile unsigned char *bytes = (volatile unsigned char *)ptr;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < size; i += page)
+    {
+        bytes[i] = bytes[i];
+    }
+    if (size > 0)
+    {
+        bytes[size - 1] = bytes[size - 1];
+    }
+}
+
+/**
+ * Returns the page mode the memory from large_alloc actually got.
+ */
+static inline page_mode large_pages(const void *ptr)
+{
+    return ((const large_header *)ptr - 1)->pages;
+}
+
+static inline void large_free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    large_header *header = (large_header *)ptr - 1;
+    if (header->mapped_size == 0)
+    {
+        free(header);
+    }
+    else
+    {
+        munmap(header, header->mapped_size);
+    }
+}
+
+#endif
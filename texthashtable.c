@@ -4,6 +4,19 @@
 #include <limits.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "large_alloc.h"
+#include "typed_table.h"
 
 /***************************************
  * Utility functions                   *
@@ -20,15 +33,117 @@ unsigned int lrot(unsigned int value, unsigned int bits)
     return (value << bits) | (value >> (sizeof(value) * CHAR_BIT) - bits);
 }
 
+/**
+ * Left-rotates the 64-bit value by the specified amount of bits.
+ */
+uint64_t lrot64(uint64_t value, unsigned int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Reads an unaligned little-endian 64-bit word.
+ */
+uint64_t read_u64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * Reads an unaligned little-endian 32-bit word.
+ */
+uint64_t read_u32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * Mixes the bits of a 64-bit value so that every input bit affects every output bit (MurmurHash3 finalizer).
+ */
+uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Gets the smallest prime number that is larger than or equal to the value.
+ */
+size_t next_prime(size_t value)
+{
+    if (value <= 2)
+    {
+        return 2;
+    }
+    for (value |= 1;; value += 2)
+    {
+        bool prime = true;
+        for (size_t divisor = 3; divisor <= value / divisor; divisor += 2)
+        {
+            if (value % divisor == 0)
+            {
+                prime = false;
+                break;
+            }
+        }
+        if (prime)
+        {
+            return value;
+        }
+    }
+}
+
+/**
+ * Runs the function on 'threads' threads, each with its own job from the jobs array, and waits for all of them.
+ * With one thread the function runs on the calling thread.
+ */
+void run_threads(int threads, void *(*run)(void *), void *jobs, size_t job_size)
+{
+    if (threads == 1)
+    {
+        run(jobs);
+        return;
+    }
+    pthread_t *handles = malloc(threads * sizeof(pthread_t));
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&handles[i], NULL, run, (unsigned char *)jobs + i * job_size);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(handles[i], NULL);
+    }
+    free(handles);
+}
+
+/***************************************
+ * Hash functions                      *
+ ***************************************/
+
+/**
+ * hash_func is the signature shared by every hash function.
+ * The seed selects a member of the hash family, giving independent hashes for the same key.
+ */
+typedef uint64_t hash_func(const void *buf, size_t size, uint64_t seed);
+
 /**
  * Gets a simple hash from the provided buffer.
  * 
  * 32-bit integers have a unique 1-to-1 mapping to a specific hash.
+ * NOTE: Only the last 4 bytes affect the result. Kept as a baseline for comparisons.
  */
-unsigned int hash(void *buf, size_t size)
+uint64_t hash_rotxor(const void *buf, size_t size, uint64_t seed)
 {
-    unsigned int result = 0;
-    unsigned char *cbuf = (unsigned char *)buf;
+    unsigned int result = (unsigned int)seed;
+    const unsigned char *cbuf = (const unsigned char *)buf;
 
     for (size_t i = 0; i < size; i++)
     {
@@ -38,289 +153,4735 @@ unsigned int hash(void *buf, size_t size)
     return result;
 }
 
-/***************************************
- * Hash table implementation           *
- ***************************************/
-
 /**
- * hash_table_entry represents an entry in the hash table.
- * It is a key-value-pair that points to the next element if it exists.
+ * 64-bit FNV-1a hash. Processes one byte per iteration.
  */
-typedef struct hash_table_entry
+uint64_t hash_fnv1a64(const void *buf, size_t size, uint64_t seed)
 {
-    struct hash_table_entry *next;
+    uint64_t result = 0xcbf29ce484222325ull ^ seed;
+    const unsigned char *cbuf = (const unsigned char *)buf;
 
-    void *key;
-    size_t key_size;
-    void *value;
-} hash_table_entry;
+    for (size_t i = 0; i < size; i++)
+    {
+        result ^= cbuf[i];
+        result *= 0x100000001b3ull;
+    }
+
+    return result;
+}
 
 /**
- * hash_table represents a hash table.
- * The 'buckets' member contains the linked lists.
+ * Multiplies a and b into a 128-bit product and returns the high and low halves xor-ed together.
  */
-typedef struct
+uint64_t wyhash_mix(uint64_t a, uint64_t b)
 {
-    size_t entries;
-    size_t capacity;
-    size_t collisions;
-    hash_table_entry **buckets;
-} hash_table;
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
 
 /**
- * Prints the collision that occured between two hash table entries.
+ * wyhash (final version 4). Processes 16 to 48 bytes per iteration using 64x64->128-bit multiplies.
  */
-void hash_table_print_collision(const char *prefix, hash_table_entry *a, hash_table_entry *b)
+uint64_t hash_wyhash(const void *buf, size_t size, uint64_t seed)
 {
-    fwrite(prefix, sizeof(char), strlen(prefix), stdout);
-    fwrite(a->key, sizeof(char), a->key_size, stdout);
-    printf(" -> ");
-    fwrite(b->key, sizeof(char), b->key_size, stdout);
-    printf("\n");
+    const uint64_t secret[] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t a, b;
+
+    seed ^= wyhash_mix(seed ^ secret[0], secret[1]);
+    if (size <= 16)
+    {
+        if (size >= 4)
+        {
+            a = (read_u32(p) << 32) | read_u32(p + ((size >> 3) << 2));
+            b = (read_u32(p + size - 4) << 32) | read_u32(p + size - 4 - ((size >> 3) << 2));
+        }
+        else if (size > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = size;
+        if (i > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = wyhash_mix(read_u64(p) ^ secret[1], read_u64(p + 8) ^ seed);
+                see1 = wyhash_mix(read_u64(p + 16) ^ secret[2], read_u64(p + 24) ^ see1);
+                see2 = wyhash_mix(read_u64(p + 32) ^ secret[3], read_u64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = wyhash_mix(read_u64(p) ^ secret[1], read_u64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read_u64(p + i - 16);
+        b = read_u64(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    __uint128_t product = (__uint128_t)a * b;
+    a = (uint64_t)product;
+    b = (uint64_t)(product >> 64);
+    return wyhash_mix(a ^ secret[0] ^ size, b ^ secret[1]);
 }
 
+const uint64_t XXH_PRIME1 = 0x9e3779b185ebca87ull;
+const uint64_t XXH_PRIME2 = 0xc2b2ae3d27d4eb4full;
+const uint64_t XXH_PRIME3 = 0x165667b19e3779f9ull;
+const uint64_t XXH_PRIME4 = 0x85ebca77c2b2ae63ull;
+const uint64_t XXH_PRIME5 = 0x27d4eb2f165667c5ull;
+
 /**
- * Creates a new hash table with the specified capacity.
+ * Mixes a single 64-bit input lane into an xxHash accumulator.
  */
-hash_table *hash_table_create(size_t capacity)
+uint64_t xxh64_round(uint64_t acc, uint64_t input)
 {
-    hash_table *table = (hash_table *)malloc(sizeof(hash_table));
-    table->entries = 0;
-    table->collisions = 0;
-    table->capacity = capacity;
-    table->buckets = (hash_table_entry **)calloc(capacity, sizeof(hash_table_entry));
-    return table;
+    acc += input * XXH_PRIME2;
+    acc = lrot64(acc, 31);
+    return acc * XXH_PRIME1;
 }
 
 /**
- * Frees the hash table.
- * NOTE: Manually allocated data that is used in entries must be freed manually.
+ * Merges an xxHash accumulator into the final hash.
  */
-void hash_table_free(hash_table *table)
+uint64_t xxh64_merge(uint64_t h, uint64_t acc)
+{
+    h ^= xxh64_round(0, acc);
+    return h * XXH_PRIME1 + XXH_PRIME4;
+}
+
+/**
+ * xxHash64. Processes 32 bytes per iteration in four independent lanes.
+ */
+uint64_t hash_xxh64(const void *buf, size_t size, uint64_t seed)
 {
-    // Free all of the buckets.
-    for (size_t i = 0; i <= table->capacity; i++)
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + size;
+    uint64_t h;
+
+    if (size >= 32)
     {
-        hash_table_entry *entry = table->buckets[i];
-        while (entry != NULL)
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME1;
+        do
         {
-            hash_table_entry *next = entry->next;
-            free(entry);
-            entry = next;
-        }
+            v1 = xxh64_round(v1, read_u64(p));
+            v2 = xxh64_round(v2, read_u64(p + 8));
+            v3 = xxh64_round(v3, read_u64(p + 16));
+            v4 = xxh64_round(v4, read_u64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = lrot64(v1, 1) + lrot64(v2, 7) + lrot64(v3, 12) + lrot64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
     }
-    // Free the bucket array.
-    free(table->buckets);
-    free(table);
+    else
+    {
+        h = seed + XXH_PRIME5;
+    }
+
+    h += size;
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= xxh64_round(0, read_u64(p));
+        h = lrot64(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (end - p >= 4)
+    {
+        h ^= read_u32(p) * XXH_PRIME1;
+        h = lrot64(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * XXH_PRIME5;
+        h = lrot64(h, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+bool cpu_has_sse42()
+{
+    return __builtin_cpu_supports("sse4.2");
 }
 
-hash_table_entry **hash_table_find_bucket(hash_table *table, void *key, size_t key_size)
+bool cpu_has_aes()
 {
-    unsigned int hashed_key = hash(key, key_size);
-    size_t index = hashed_key % table->capacity;
-    return &table->buckets[index];
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse4.1");
 }
 
 /**
- * Adds an entry to the hash table.
+ * CRC32C hash using the SSE4.2 crc32 instruction, 8 bytes per instruction.
+ * The CRC only has 32 bits of entropy, which are spread over 64 bits by mix64.
  */
-void hash_table_add(hash_table *table, void *key, size_t key_size, void *value)
+__attribute__((target("sse4.2"))) uint64_t hash_crc32c(const void *buf, size_t size, uint64_t seed)
 {
-    // Create new entry.
-    hash_table_entry *new_entry = calloc(1, sizeof(hash_table_entry));
-    new_entry->key = key;
-    new_entry->key_size = key_size;
-    new_entry->value = value;
-
-    // Find target index.
-    hash_table_entry **entry = hash_table_find_bucket(table, key, key_size);
-    hash_table_entry **first_entry = entry;
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t crc = (uint32_t)seed ^ 0xffffffffu;
 
-    // Collision occurred.
-    if (*entry != NULL)
+    for (; size >= 8; size -= 8, p += 8)
     {
-        table->collisions++;
-        hash_table_print_collision("!COLLISION! | add: ", *first_entry, new_entry);
+        crc = _mm_crc32_u64(crc, read_u64(p));
+    }
+    if (size >= 4)
+    {
+        crc = _mm_crc32_u32((uint32_t)crc, (uint32_t)read_u32(p));
+        size -= 4;
+        p += 4;
+    }
+    for (; size > 0; size--, p++)
+    {
+        crc = _mm_crc32_u8((uint32_t)crc, *p);
     }
 
-    // Update the first entry to the newly created entry and link to next.
-    new_entry->next = *entry;
-    *entry = new_entry;
-    table->entries++;
+    return mix64(crc ^ (seed & 0xffffffff00000000ull));
 }
 
 /**
- * Performs lookup in the hash table based on the key and writes the value to the value pointer.
- * If the function does not find a match, it returns false and the value pointer is not written to.
+ * Hash built on the AES-NI round instruction, 16 bytes per two rounds.
+ * A single round per block does not diffuse short keys well enough, which shows up as extra collisions.
  */
-bool hash_table_lookup(hash_table *table, void *key, size_t key_size, void **value)
+__attribute__((target("aes,sse4.1"))) uint64_t hash_aes(const void *buf, size_t size, uint64_t seed)
 {
-    // Find target index.
-    hash_table_entry *entry = *hash_table_find_bucket(table, key, key_size);
-    hash_table_entry *first_entry = entry;
+    const unsigned char *p = (const unsigned char *)buf;
+    const __m128i key = _mm_set_epi64x(0x243f6a8885a308d3ll, 0x13198a2e03707344ll);
+    __m128i state = _mm_set_epi64x((long long)seed, (long long)size);
 
-    // Multiple keys can have same hash!
-    // We need to find the entry with precisely the same key.
-    bool found = false;
-    while (entry != NULL && !found)
+    for (; size >= 16; size -= 16, p += 16)
     {
-        // We have found a match if key size and key contents are equal.
-        if (entry->key_size == key_size && memcmp(entry->key, key, key_size) == 0)
-        {
-            *value = entry->value;
-            found = true;
-            break;
-        }
-
-        entry = entry->next;
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        state = _mm_aesenc_si128(_mm_xor_si128(state, block), key);
+        state = _mm_aesenc_si128(state, key);
     }
-
-    // Print collision
-    if (found && first_entry != entry)
+    if (size > 0)
     {
-        hash_table_print_collision("!COLLISION! | lookup: ", entry, first_entry);
+        unsigned char tail[16] = {0};
+        memcpy(tail, p, size);
+        __m128i block = _mm_loadu_si128((const __m128i *)tail);
+        state = _mm_aesenc_si128(_mm_xor_si128(state, block), key);
+        state = _mm_aesenc_si128(state, key);
     }
 
-    return found;
+    state = _mm_aesenc_si128(state, key);
+    state = _mm_aesenc_si128(state, _mm_shuffle_epi32(key, 0x4e));
+    return (uint64_t)_mm_extract_epi64(state, 0) ^ (uint64_t)_mm_extract_epi64(state, 1);
+}
+#else
+bool cpu_has_sse42()
+{
+    return false;
 }
 
-/**
- * Gets the number of entries in the hash table. 
- */
-size_t hash_table_entries(hash_table *table)
+bool cpu_has_aes()
 {
-    return table->entries;
+    return false;
 }
 
-/**
- * Gets the load factor (entries / capacity) of the hash table.
- */
-float hash_table_load_factor(hash_table *table)
+uint64_t hash_crc32c(const void *buf, size_t size, uint64_t seed)
 {
-    return (float)table->entries / (float)table->capacity;
+    return hash_wyhash(buf, size, seed);
+}
+
+uint64_t hash_aes(const void *buf, size_t size, uint64_t seed)
+{
+    return hash_wyhash(buf, size, seed);
+}
+#endif
+
+bool cpu_has_baseline()
+{
+    return true;
 }
 
 /**
- * Gets the number of collisions in the hash table.
+ * hash_algorithm describes a selectable hash function.
+ * Algorithms requiring specific CPU features are only available if the CPU supports them.
  */
-size_t hash_table_collisions(hash_table *table)
+typedef struct
 {
-    return table->collisions;
-}
+    const char *name;
+    hash_func *func;
+    bool (*available)();
+} hash_algorithm;
 
-/***************************************
- * Program code                        *
- ***************************************/
-const char MAIKEN_NAME[] = "Maiken Louise Brechan";
-const char MARTIN_NAME[] = "Martin Dolmen Helmersen";
-const char MAGNUS_NAME[] = "Magnus Hektoen Steensland";
-const char NORBERT_NAME[] = "Norbert Arkadiusz Görke";
-const char EULER_NAME[] = "Leonhard Euler";
-const int HASH_TABLE_CAPACITY = 127;
+const hash_algorithm hash_algorithms[] = {
+    {"rotxor", &hash_rotxor, &cpu_has_baseline},
+    {"fnv1a64", &hash_fnv1a64, &cpu_has_baseline},
+    {"wyhash", &hash_wyhash, &cpu_has_baseline},
+    {"xxh64", &hash_xxh64, &cpu_has_baseline},
+    {"crc32c", &hash_crc32c, &cpu_has_sse42},
+    {"aes", &hash_aes, &cpu_has_aes},
+};
+const int hash_algorithms_length = sizeof(hash_algorithms) / sizeof(hash_algorithms[0]);
 
 /**
- * Performs a person ID lookup in the hash table.
- * Returns -1 if a person with the specified name is not found.
+ * Gets the fastest hash function with good mixing that the CPU supports.
  */
-int person_lookup(hash_table *table, const char *name, size_t name_size)
+const hash_algorithm *hash_algorithm_best()
 {
-    void *id;
-    if (!hash_table_lookup(table, (void *)name, name_size, &id))
+    const hash_algorithm *best = NULL;
+    for (int i = 0; i < hash_algorithms_length; i++)
     {
-        return -1;
+        if (strcmp(hash_algorithms[i].name, "aes") == 0 && hash_algorithms[i].available())
+        {
+            return &hash_algorithms[i];
+        }
+        if (strcmp(hash_algorithms[i].name, "wyhash") == 0)
+        {
+            best = &hash_algorithms[i];
+        }
     }
-    return (int)(uintptr_t)id;
+    return best;
 }
 
 /**
- * Runs the program with the specified buffer.
- * The names in the buffer, including the final one, must be newline-delimited.
+ * Finds an available hash algorithm by name. "auto" selects the best one for the CPU.
+ * Returns NULL if the algorithm does not exist or is not supported by the CPU.
  */
-void run_with_buffer(const char *names, size_t size)
+const hash_algorithm *hash_algorithm_find(const char *name)
 {
-    hash_table *table = hash_table_create(HASH_TABLE_CAPACITY);
-
-    printf("Filling hash table...\n");
-    int person_id = 0;
-    size_t start = 0;
-    for (size_t i = 0; i < size; i++)
+    if (strcmp(name, "auto") == 0)
+    {
+        return hash_algorithm_best();
+    }
+    for (int i = 0; i < hash_algorithms_length; i++)
     {
-        if (names[i] == '\n')
+        if (strcmp(hash_algorithms[i].name, name) == 0)
         {
-            hash_table_add(table, (void *)&names[start], i - start, (void *)(uintptr_t)person_id++);
-            start = i + 1;
+            return hash_algorithms[i].available() ? &hash_algorithms[i] : NULL;
         }
     }
-    printf("Hash table filled!\n\n");
-
-    size_t entries = hash_table_entries(table);
-    float load_factor = hash_table_load_factor(table);
-    size_t collisions = hash_table_collisions(table);
-    float collisions_per_person = (float)collisions / (float)hash_table_entries(table);
-
-    printf("Statistics:\n");
-    printf("   Capacity              : %d\n", HASH_TABLE_CAPACITY);
-    printf("   Persons registered    : %ld\n", entries);
-    printf("   Collisions            : %ld\n", collisions);
-    printf("   Load factor           : %f\n", load_factor);
-    printf("   Collisions per person : %f\n", collisions_per_person);
+    return NULL;
+}
 
-    printf("Lookups:\n");
-    printf("   %s: (ID=%d)\n", MAIKEN_NAME, person_lookup(table, MAIKEN_NAME, sizeof(MAIKEN_NAME) - 1));
-    printf("   %s: (ID=%d)\n", MARTIN_NAME, person_lookup(table, MARTIN_NAME, sizeof(MARTIN_NAME) - 1));
-    printf("   %s: (ID=%d)\n", MAGNUS_NAME, person_lookup(table, MAGNUS_NAME, sizeof(MAGNUS_NAME) - 1));
-    printf("   %s: (ID=%d)\n", NORBERT_NAME, person_lookup(table, NORBERT_NAME, sizeof(NORBERT_NAME) - 1));
-    printf("   %s: (ID=%d)\n", EULER_NAME, person_lookup(table, EULER_NAME, sizeof(EULER_NAME) - 1));
+/***************************************
+ * Memory arena                        *
+ ***************************************/
 
-    hash_table_free(table);
-}
+/**
+ * arena_block is a chunk of memory that allocations are carved out of.
+ */
+typedef struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} arena_block;
 
 /**
- * Runs the program using a file.
- * The names in the file, including the final one, must be newline-delimited.
+ * arena is a bump-pointer allocator.
+ * Allocations cannot be freed individually, instead the whole arena is released at once.
  */
-int run_with_file(FILE *fp)
+typedef struct
 {
-    // Determine the file size.
-    fseek(fp, 0, SEEK_END);
-    size_t size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    char *names = malloc(size);
+    arena_block *head;
+    size_t block_size;
+    size_t allocated;
+} arena;
 
-    // Read file into buffer.
-    fread(names, sizeof(char), size, fp);
-    run_with_buffer(names, size);
+const size_t ARENA_DEFAULT_BLOCK_SIZE = 64 * 1024;
 
-    free(names);
-    return 0;
+/**
+ * Creates a new arena that allocates memory in blocks of the specified size.
+ */
+arena *arena_create(size_t block_size)
+{
+    arena *a = (arena *)calloc(1, sizeof(arena));
+    a->block_size = block_size;
+    return a;
 }
 
-int handle_file(const char *file_path)
+/**
+ * Allocates uninitialized memory from the arena.
+ * The alignment must be a power of two no larger than alignof(max_align_t).
+ */
+void *arena_alloc(arena *a, size_t size, size_t alignment)
 {
-    FILE *file = fopen(file_path, "r");
+    arena_block *block = a->head;
+    size_t offset = block != NULL ? (block->used + alignment - 1) & ~(alignment - 1) : 0;
 
-    if (file == NULL)
+    // Start a new block if the allocation does not fit. Large allocations get a block of their own.
+    if (block == NULL || offset + size > block->size)
     {
-        perror("Unable to open file.");
-        return 1;
+        size_t block_size = size > a->block_size ? size : a->block_size;
+        block = (arena_block *)malloc(sizeof(arena_block) + block_size);
+        block->size = block_size;
+        block->next = a->head;
+        a->head = block;
+        offset = 0;
     }
-    return run_with_file(file);
-}
 
-void print_help()
-{
-    printf(
-        "You must specify which file to read from as an argument to the program.\n"
-        "Usage: texthashtable <file_name>\n"
-        "E.g. ./texthashtable ~/navn.txt\n");
+    block->used = offset + size;
+    a->allocated += size;
+    return (unsigned char *)block->data + offset;
 }
 
-int main(int argc, char const *argv[])
+/**
+ * Frees the arena and every allocation made from it.
+ */
+void arena_free(arena *a)
 {
-    if (argc < 2)
+    arena_block *block = a->head;
+    while (block != NULL)
     {
-        print_help();
-        return 1;
+        arena_block *next = block->next;
+        free(block);
+        block = next;
     }
-    handle_file(argv[1]);
+    free(a);
+}
+
+/***************************************
+ * Mode names                          *
+ ***************************************/
+
+/**
+ * Returns the index of the name in the array of mode names, or -1 if it is not there.
+ */
+int find_mode_name(const char *const names[], int names_length, const char *name)
+{
+    for (int i = 0; i < names_length; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/***************************************
+ * Statistics and tracing              *
+ ***************************************/
+
+/**
+ * lookup_stats counts lookups, and how deep into the chain (or probe sequence) the hits were found.
+ * The last histogram bucket holds every depth from LOOKUP_DEPTH_BUCKETS - 1 and up.
+ */
+#define LOOKUP_DEPTH_BUCKETS 8
+
+typedef struct
+{
+    size_t lookups;
+    size_t hits;
+    size_t depth[LOOKUP_DEPTH_BUCKETS];
+} lookup_stats;
+
+/**
+ * Records a lookup in the statistics. The depth is only recorded for hits.
+ */
+void lookup_stats_record(lookup_stats *stats, bool found, size_t depth)
+{
+    stats->lookups++;
+    if (found)
+    {
+        stats->hits++;
+        stats->depth[depth < LOOKUP_DEPTH_BUCKETS - 1 ? depth : LOOKUP_DEPTH_BUCKETS - 1]++;
+    }
+}
+
+typedef enum
+{
+    TRACE_ADD_COLLISION,
+    TRACE_LOOKUP_COLLISION,
+} trace_event_type;
+
+/**
+ * trace_event describes a collision between two keys.
+ * The keys are not copied, so they must stay valid until the event has been written.
+ */
+typedef struct
+{
+    trace_event_type type;
+    const void *key;
+    size_t key_size;
+    const void *other_key;
+    size_t other_key_size;
+} trace_event;
+
+typedef struct
+{
+    atomic_size_t sequence;
+    trace_event event;
+} trace_cell;
+
+/**
+ * trace_ring is a bounded lock-free queue of trace events with a writer thread printing them.
+ * 
+ * Any number of threads may publish events. Every cell has a sequence number telling whether it is
+ * free for the producer claiming that position or ready for the writer. When the ring is full the
+ * event is dropped and counted, so the hot path never blocks on the output.
+ */
+typedef struct
+{
+    trace_cell *cells;
+    size_t mask;
+    atomic_size_t head;
+    size_t tail;
+    atomic_size_t written;
+    atomic_size_t dropped;
+
+    FILE *out;
+    atomic_bool running;
+    pthread_t writer;
+} trace_ring;
+
+/**
+ * Publishes an event to the ring. Returns false if the ring is full and the event was dropped.
+ */
+bool trace_ring_publish(trace_ring *ring, const trace_event *event)
+{
+    size_t position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_cell *cell;
+    for (;;)
+    {
+        cell = &ring->cells[position & ring->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    cell->event = *event;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Takes the oldest event from the ring. Must only be called by the writer thread.
+ * Returns false if the ring is empty.
+ */
+bool trace_ring_consume(trace_ring *ring, trace_event *event)
+{
+    trace_cell *cell = &ring->cells[ring->tail & ring->mask];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    if (sequence != ring->tail + 1)
+    {
+        return false;
+    }
+
+    *event = cell->event;
+    atomic_store_explicit(&cell->sequence, ring->tail + ring->mask + 1, memory_order_release);
+    ring->tail++;
+    return true;
+}
+
+/**
+ * Writes the event in the same format the collisions used to be printed in.
+ */
+void trace_event_write(FILE *out, const trace_event *event)
+{
+    fputs(event->type == TRACE_ADD_COLLISION ? "!COLLISION! | add: " : "!COLLISION! | lookup: ", out);
+    fwrite(event->key, sizeof(char), event->key_size, out);
+    fputs(" -> ", out);
+    fwrite(event->other_key, sizeof(char), event->other_key_size, out);
+    fputc('\n', out);
+}
+
+/**
+ * The writer thread. Drains the ring until it is stopped and empty.
+ */
+void *trace_ring_writer(void *arg)
+{
+    trace_ring *ring = (trace_ring *)arg;
+    const struct timespec idle = {.tv_sec = 0, .tv_nsec = 1000000};
+    trace_event event;
+    for (;;)
+    {
+        if (trace_ring_consume(ring, &event))
+        {
+            trace_event_write(ring->out, &event);
+            atomic_fetch_add_explicit(&ring->written, 1, memory_order_release);
+        }
+        else if (atomic_load_explicit(&ring->running, memory_order_acquire))
+        {
+            nanosleep(&idle, NULL);
+        }
+        else if (atomic_load_explicit(&ring->head, memory_order_acquire) == ring->tail)
+        {
+            break;
+        }
+    }
+    fflush(ring->out);
+    return NULL;
+}
+
+/**
+ * Creates a trace ring with room for at least the specified number of events and starts its writer thread.
+ */
+trace_ring *trace_ring_create(size_t min_capacity, FILE *out)
+{
+    size_t capacity = 1;
+    while (capacity < min_capacity)
+    {
+        capacity *= 2;
+    }
+
+    trace_ring *ring = (trace_ring *)calloc(1, sizeof(trace_ring));
+    ring->cells = (trace_cell *)calloc(capacity, sizeof(trace_cell));
+    for (size_t i = 0; i < capacity; i++)
+    {
+        atomic_init(&ring->cells[i].sequence, i);
+    }
+    ring->mask = capacity - 1;
+    ring->out = out;
+    atomic_init(&ring->running, true);
+    pthread_create(&ring->writer, NULL, &trace_ring_writer, ring);
+    return ring;
+}
+
+/**
+ * Waits until the writer has written every event published so far.
+ * Call this before freeing the memory of keys that may be referenced by events.
+ */
+void trace_ring_flush(trace_ring *ring)
+{
+    const struct timespec wait = {.tv_sec = 0, .tv_nsec = 100000};
+    size_t published = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while (atomic_load_explicit(&ring->written, memory_order_acquire) < published)
+    {
+        nanosleep(&wait, NULL);
+    }
+}
+
+/**
+ * Stops the writer thread after it has written every published event, and frees the ring.
+ */
+void trace_ring_free(trace_ring *ring)
+{
+    atomic_store_explicit(&ring->running, false, memory_order_release);
+    pthread_join(ring->writer, NULL);
+    free(ring->cells);
+    free(ring);
+}
+
+/**
+ * Gets the number of events that were dropped because the ring was full.
+ */
+size_t trace_ring_dropped(trace_ring *ring)
+{
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
+
+/**
+ * Publishes a collision between two keys, if tracing is enabled.
+ */
+void trace_collision(trace_ring *ring, trace_event_type type, const void *key, size_t key_size, const void *other_key, size_t other_key_size)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    trace_event event = {
+        .type = type,
+        .key = key,
+        .key_size = key_size,
+        .other_key = other_key,
+        .other_key_size = other_key_size,
+    };
+    trace_ring_publish(ring, &event);
+}
+
+/***************************************
+ * Bloom filter                        *
+ ***************************************/
+
+/**
+ * bloom_filter is a blocked Bloom filter. All bits of a key are in one 64-byte block picked by a mix of its hash,
+ * so adding or checking a key touches a single cache line. The bits within the block are picked by
+ * double hashing a second, different remix, which keeps them independent of the block and of the table's bucket.
+ * Both are mixed because some hash functions, like rotxor, only set the low 32 bits.
+ */
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+#define BLOOM_MAX_HASHES 16
+// Remixes the hash for the bits within the block, so they do not follow from the block index
+#define BLOOM_BIT_SEED 0x9e3779b97f4a7c15ull
+
+typedef struct
+{
+    // block_count blocks of BLOOM_BLOCK_WORDS words, or NULL if there is no filter
+    uint64_t *blocks;
+    size_t block_count;
+    unsigned int hashes;
+} bloom_filter;
+
+/**
+ * Creates a filter sized for the number of keys at bits_per_key bits each.
+ * With 0 bits per key there is no filter, and every key may be in it.
+ */
+bloom_filter bloom_filter_create(size_t keys, unsigned int bits_per_key, const memory_options *memory)
+{
+    bloom_filter filter = {NULL, 0, 0};
+    if (bits_per_key == 0)
+    {
+        return filter;
+    }
+    filter.block_count = (keys * bits_per_key + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    filter.block_count = filter.block_count > 0 ? filter.block_count : 1;
+    // bits_per_key * ln(2) hashes gives the lowest false-positive rate
+    filter.hashes = (bits_per_key * 693 + 500) / 1000;
+    filter.hashes = filter.hashes < 1 ? 1 : filter.hashes > BLOOM_MAX_HASHES ? BLOOM_MAX_HASHES : filter.hashes;
+    filter.blocks = (uint64_t *)large_alloc(filter.block_count * BLOOM_BLOCK_WORDS * sizeof(uint64_t), memory);
+    return filter;
+}
+
+void bloom_filter_free(bloom_filter *filter)
+{
+    large_free(filter->blocks);
+    filter->blocks = NULL;
+    filter->block_count = 0;
+}
+
+/**
+ * Gets the index of the block of the hash.
+ */
+size_t bloom_filter_block_index(const bloom_filter *filter, uint64_t hash)
+{
+    return (size_t)(((__uint128_t)mix64(hash) * filter->block_count) >> 64);
+}
+
+uint64_t *bloom_filter_block(const bloom_filter *filter, uint64_t hash)
+{
+    return &filter->blocks[bloom_filter_block_index(filter, hash) * BLOOM_BLOCK_WORDS];
+}
+
+/**
+ * Adds the hash to the filter. Does nothing if there is no filter.
+ */
+void bloom_filter_add(bloom_filter *filter, uint64_t hash)
+{
+    if (filter->blocks == NULL)
+    {
+        return;
+    }
+    uint64_t *block = bloom_filter_block(filter, hash);
+    uint64_t mixed = mix64(hash ^ BLOOM_BIT_SEED);
+    uint32_t bit = (uint32_t)mixed;
+    uint32_t step = (uint32_t)(mixed >> 32) | 1;
+    for (unsigned int i = 0; i < filter->hashes; i++, bit += step)
+    {
+        block[(bit % BLOOM_BLOCK_BITS) / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
+
+/**
+ * Returns false if the hash was never added. True means it may have been.
+ */
+bool bloom_filter_contains(const bloom_filter *filter, uint64_t hash)
+{
+    if (filter->blocks == NULL)
+    {
+        return true;
+    }
+    const uint64_t *block = bloom_filter_block(filter, hash);
+    uint64_t mixed = mix64(hash ^ BLOOM_BIT_SEED);
+    uint32_t bit = (uint32_t)mixed;
+    uint32_t step = (uint32_t)(mixed >> 32) | 1;
+    for (unsigned int i = 0; i < filter->hashes; i++, bit += step)
+    {
+        if ((block[(bit % BLOOM_BLOCK_BITS) / 64] & ((uint64_t)1 << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/***************************************
+ * Hash table implementation           *
+ ***************************************/
+
+/**
+ * Keys up to this many bytes can be stored inside the entry, which makes the entry exactly one cache line.
+ */
+#define HASH_TABLE_INLINE_KEY_SIZE 24
+
+/**
+ * hash_table_entry represents an entry in the hash table.
+ * It is a key-value-pair that points to the next element if it exists.
+ *
+ * The full hash of the key is kept, so a chain walk rejects other keys without touching their bytes,
+ * and growing the table does not hash the keys again. 'key' points at 'inline_key' when the key is stored inline.
+ */
+typedef struct hash_table_entry
+{
+    struct hash_table_entry *next;
+    uint64_t hash;
+
+    void *key;
+    size_t key_size;
+    void *value;
+    unsigned char inline_key[HASH_TABLE_INLINE_KEY_SIZE];
+} hash_table_entry;
+
+/**
+ * hash_table_key_storage determines where the table keeps the keys.
+ *
+ * HASH_TABLE_KEYS_BORROWED points at the caller's keys, which must outlive the table.
+ * HASH_TABLE_KEYS_INLINE copies keys of up to HASH_TABLE_INLINE_KEY_SIZE bytes into the entry and borrows longer ones.
+ * HASH_TABLE_KEYS_COPIED also copies the longer keys, into a string arena owned by the table,
+ * so the table does not depend on the caller's buffer at all.
+ */
+typedef enum
+{
+    HASH_TABLE_KEYS_BORROWED,
+    HASH_TABLE_KEYS_INLINE,
+    HASH_TABLE_KEYS_COPIED,
+} hash_table_key_storage;
+
+const char *const hash_table_key_storage_names[] = {"borrowed", "inline", "copy"};
+
+/**
+ * hash_table_rehash_mode determines how the table grows once the load factor threshold is crossed.
+ * 
+ * HASH_TABLE_REHASH_FULL moves every entry to the new bucket array at once (stop-the-world).
+ * HASH_TABLE_REHASH_INCREMENTAL keeps both bucket arrays alive and moves a few buckets on every
+ * add and lookup, so the cost of growing is spread out over many operations.
+ */
+typedef enum
+{
+    HASH_TABLE_REHASH_NONE,
+    HASH_TABLE_REHASH_FULL,
+    HASH_TABLE_REHASH_INCREMENTAL,
+} hash_table_rehash_mode;
+
+/**
+ * hash_table_allocator supplies the memory for hash table entries.
+ * If 'free' is NULL, entries are never freed individually and the allocator's owner releases them in bulk.
+ */
+typedef struct
+{
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+} hash_table_allocator;
+
+void *heap_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+void heap_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+void *arena_allocator_alloc(void *ctx, size_t size)
+{
+    return arena_alloc((arena *)ctx, size, _Alignof(max_align_t));
+}
+
+/**
+ * Gets an allocator that allocates every entry separately on the heap.
+ */
+hash_table_allocator hash_table_heap_allocator()
+{
+    return (hash_table_allocator){
+        .alloc = &heap_alloc,
+        .free = &heap_free,
+        .ctx = NULL,
+    };
+}
+
+/**
+ * Gets an allocator that allocates entries from the arena.
+ * The arena must outlive the table, and is not freed by hash_table_free.
+ */
+hash_table_allocator hash_table_arena_allocator(arena *a)
+{
+    return (hash_table_allocator){
+        .alloc = &arena_allocator_alloc,
+        .free = NULL,
+        .ctx = a,
+    };
+}
+
+/**
+ * hash_table_options configures the behaviour of a hash table.
+ * Use hash_table_default_options() to get sane defaults and override what you need.
+ */
+typedef struct
+{
+    hash_table_rehash_mode rehash_mode;
+    // The table grows when the load factor exceeds this value.
+    float max_load_factor;
+    // Number of old buckets that are migrated per operation in incremental mode.
+    size_t rehash_step;
+    // The hash function used for the keys, and the seed passed to it.
+    hash_func *hash;
+    uint64_t seed;
+    // Collisions are published to this ring. If NULL, only the counters are updated.
+    trace_ring *trace;
+    // Allocator for the entries. If NULL, the table allocates entries from an arena of its own.
+    const hash_table_allocator *allocator;
+    // Page size and NUMA placement of the bucket arrays.
+    memory_options memory;
+    // Where the keys are kept.
+    hash_table_key_storage key_storage;
+    // Bits per key of the Bloom filter checked before the chains, or 0 for no filter.
+    unsigned int bloom_bits_per_key;
+    // Number of shards of a sharded table, a power of two. Ignored by the other tables.
+    size_t shards;
+} hash_table_options;
+
+/**
+ * hash_table represents a hash table.
+ * The 'buckets' member contains the linked lists.
+ * 
+ * While an incremental rehash is in progress, 'old_buckets' holds the previous bucket array.
+ * Every old bucket is either still intact or has been emptied into 'buckets', never partially moved.
+ *
+ * The Bloom filter is sized with the bucket array. A new one is made when the table grows, and the
+ * entries are added to it as they are migrated, so 'old_bloom' covers the old buckets until they are empty.
+ */
+typedef struct
+{
+    size_t entries;
+    size_t capacity;
+    size_t collisions;
+    hash_table_entry **buckets;
+
+    hash_table_entry **old_buckets;
+    size_t old_capacity;
+    size_t rehash_index;
+    size_t rehashes;
+    lookup_stats lookup_stats;
+
+    bloom_filter bloom;
+    bloom_filter old_bloom;
+    // Lookups of missing keys that the filter answered, and that it let through to the chain
+    size_t bloom_rejects;
+    size_t bloom_false_positives;
+
+    hash_table_allocator allocator;
+    arena *entry_arena;
+    // Copies of the keys that do not fit inline, with HASH_TABLE_KEYS_COPIED
+    arena *key_arena;
+    hash_table_options options;
+} hash_table;
+
+/**
+ * Gets the default hash table options.
+ */
+hash_table_options hash_table_default_options()
+{
+    return (hash_table_options){
+        .rehash_mode = HASH_TABLE_REHASH_INCREMENTAL,
+        .max_load_factor = 1.0f,
+        .rehash_step = 4,
+        .hash = hash_algorithm_best()->func,
+        .seed = 0,
+        .trace = NULL,
+        .allocator = NULL,
+        .memory = {PAGES_DEFAULT, NUMA_DEFAULT},
+        .key_storage = HASH_TABLE_KEYS_INLINE,
+        .bloom_bits_per_key = 0,
+        .shards = 16,
+    };
+}
+
+/**
+ * Creates a Bloom filter for as many keys as the buckets fit within the max load factor.
+ */
+bloom_filter hash_table_bloom_create(hash_table *table)
+{
+    size_t keys = (size_t)(table->capacity * table->options.max_load_factor) + 1;
+    return bloom_filter_create(keys, table->options.bloom_bits_per_key, &table->options.memory);
+}
+
+/**
+ * Creates a new hash table with the specified capacity.
+ * If options is NULL, the default options are used.
+ */
+hash_table *hash_table_create(size_t capacity, const hash_table_options *options)
+{
+    hash_table *table = (hash_table *)calloc(1, sizeof(hash_table));
+    table->capacity = capacity;
+    table->options = options != NULL ? *options : hash_table_default_options();
+    table->buckets = (hash_table_entry **)large_alloc(capacity * sizeof(hash_table_entry *), &table->options.memory);
+    if (table->options.rehash_step == 0)
+    {
+        table->options.rehash_step = 1;
+    }
+    if (table->options.hash == NULL)
+    {
+        table->options.hash = hash_algorithm_best()->func;
+    }
+    if (table->options.allocator != NULL)
+    {
+        table->allocator = *table->options.allocator;
+    }
+    else
+    {
+        table->entry_arena = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+        table->allocator = hash_table_arena_allocator(table->entry_arena);
+    }
+    if (table->options.key_storage == HASH_TABLE_KEYS_COPIED)
+    {
+        table->key_arena = arena_create(ARENA_DEFAULT_BLOCK_SIZE);
+    }
+    table->bloom = hash_table_bloom_create(table);
+    return table;
+}
+
+/**
+ * Frees all entries in the bucket array, unless the allocator releases them in bulk.
+ */
+void hash_table_free_buckets(hash_table *table, hash_table_entry **buckets, size_t capacity)
+{
+    for (size_t i = 0; i < capacity && table->allocator.free != NULL; i++)
+    {
+        hash_table_entry *entry = buckets[i];
+        while (entry != NULL)
+        {
+            hash_table_entry *next = entry->next;
+            table->allocator.free(table->allocator.ctx, entry);
+            entry = next;
+        }
+    }
+    large_free(buckets);
+}
+
+/**
+ * Frees the hash table.
+ * NOTE: Manually allocated data that is used in entries must be freed manually.
+ */
+void hash_table_free(hash_table *table)
+{
+    if (table->old_buckets != NULL)
+    {
+        hash_table_free_buckets(table, table->old_buckets, table->old_capacity);
+    }
+    hash_table_free_buckets(table, table->buckets, table->capacity);
+    if (table->entry_arena != NULL)
+    {
+        arena_free(table->entry_arena);
+    }
+    if (table->key_arena != NULL)
+    {
+        arena_free(table->key_arena);
+    }
+    bloom_filter_free(&table->bloom);
+    bloom_filter_free(&table->old_bloom);
+    free(table);
+}
+
+/**
+ * Hashes the key with the hash function selected for the table.
+ */
+uint64_t hash_table_hash(hash_table *table, const void *key, size_t key_size)
+{
+    return table->options.hash(key, key_size, table->options.seed);
+}
+
+/**
+ * Gets the bucket in the bucket array the hashed key belongs to.
+ */
+hash_table_entry **hash_table_find_bucket_in(hash_table_entry **buckets, size_t capacity, uint64_t hashed_key)
+{
+    size_t index = hashed_key % capacity;
+    return &buckets[index];
+}
+
+/**
+ * Moves every entry of the old bucket into the current bucket array.
+ */
+void hash_table_migrate_bucket(hash_table *table, hash_table_entry **old_bucket)
+{
+    // Reverse the chain first so that prepending keeps the newest entry first.
+    hash_table_entry *reversed = NULL;
+    hash_table_entry *entry = *old_bucket;
+    while (entry != NULL)
+    {
+        hash_table_entry *next = entry->next;
+        entry->next = reversed;
+        reversed = entry;
+        entry = next;
+    }
+    *old_bucket = NULL;
+
+    while (reversed != NULL)
+    {
+        hash_table_entry *next = reversed->next;
+        hash_table_entry **bucket = hash_table_find_bucket_in(table->buckets, table->capacity, reversed->hash);
+        reversed->next = *bucket;
+        *bucket = reversed;
+        bloom_filter_add(&table->bloom, reversed->hash);
+        reversed = next;
+    }
+}
+
+/**
+ * Migrates up to 'steps' old buckets to the current bucket array.
+ * Frees the old bucket array once every bucket has been migrated.
+ */
+void hash_table_rehash_step(hash_table *table, size_t steps)
+{
+    if (table->old_buckets == NULL)
+    {
+        return;
+    }
+
+    for (; steps > 0 && table->rehash_index < table->old_capacity; steps--)
+    {
+        hash_table_migrate_bucket(table, &table->old_buckets[table->rehash_index++]);
+    }
+
+    if (table->rehash_index == table->old_capacity)
+    {
+        large_free(table->old_buckets);
+        bloom_filter_free(&table->old_bloom);
+        table->old_buckets = NULL;
+        table->old_capacity = 0;
+        table->rehash_index = 0;
+    }
+}
+
+/**
+ * Grows the bucket array.
+ * In incremental mode the entries are only moved over as the table is used.
+ */
+void hash_table_grow(hash_table *table)
+{
+    // Only one rehash can be in progress at a time.
+    if (table->old_buckets != NULL)
+    {
+        hash_table_rehash_step(table, table->old_capacity);
+    }
+
+    table->old_buckets = table->buckets;
+    table->old_capacity = table->capacity;
+    table->rehash_index = 0;
+    // Keep the capacity prime so that the modulo reduction uses all hash bits.
+    table->capacity = next_prime(table->capacity * 2 + 1);
+    table->buckets = (hash_table_entry **)large_alloc(table->capacity * sizeof(hash_table_entry *), &table->options.memory);
+    table->old_bloom = table->bloom;
+    table->bloom = hash_table_bloom_create(table);
+    table->rehashes++;
+
+    if (table->options.rehash_mode == HASH_TABLE_REHASH_FULL)
+    {
+        hash_table_rehash_step(table, table->old_capacity);
+    }
+}
+
+/**
+ * Finds the bucket the key currently lives in.
+ * During an incremental rehash this is the old bucket until it has been migrated.
+ */
+hash_table_entry **hash_table_find_bucket(hash_table *table, uint64_t hashed_key)
+{
+    if (table->old_buckets != NULL)
+    {
+        hash_table_entry **old_bucket = hash_table_find_bucket_in(table->old_buckets, table->old_capacity, hashed_key);
+        if (*old_bucket != NULL)
+        {
+            return old_bucket;
+        }
+    }
+    return hash_table_find_bucket_in(table->buckets, table->capacity, hashed_key);
+}
+
+/**
+ * Gets the key to store for an entry: a copy in the table's string arena if the table copies keys
+ * and it does not fit inline, otherwise the key itself. Not thread-safe.
+ */
+void *hash_table_own_key(hash_table *table, void *key, size_t key_size)
+{
+    if (table->options.key_storage != HASH_TABLE_KEYS_COPIED || key_size <= HASH_TABLE_INLINE_KEY_SIZE)
+    {
+        return key;
+    }
+    void *copy = arena_alloc(table->key_arena, key_size, 1);
+    memcpy(copy, key, key_size);
+    return copy;
+}
+
+/**
+ * Stores the hash and key in the entry, inline if the table keeps short keys inline and the key fits.
+ */
+void hash_table_entry_set_key(hash_table *table, hash_table_entry *entry, uint64_t hashed_key, void *key, size_t key_size)
+{
+    entry->hash = hashed_key;
+    entry->key_size = key_size;
+    if (table->options.key_storage != HASH_TABLE_KEYS_BORROWED && key_size <= HASH_TABLE_INLINE_KEY_SIZE)
+    {
+        memcpy(entry->inline_key, key, key_size);
+        entry->key = entry->inline_key;
+    }
+    else
+    {
+        entry->key = key;
+    }
+}
+
+/**
+ * Adds an entry to the hash table, with the key already hashed by hash_table_hash.
+ */
+void hash_table_add_hashed(hash_table *table, uint64_t hashed_key, void *key, size_t key_size, void *value)
+{
+    // Create new entry.
+    hash_table_entry *new_entry = table->allocator.alloc(table->allocator.ctx, sizeof(hash_table_entry));
+    hash_table_entry_set_key(table, new_entry, hashed_key, hash_table_own_key(table, key, key_size), key_size);
+    new_entry->value = value;
+
+    hash_table_rehash_step(table, table->options.rehash_step);
+
+    // Make sure the key's old bucket has been migrated, so that every entry with this key ends up in the same chain.
+    if (table->old_buckets != NULL)
+    {
+        hash_table_migrate_bucket(table, hash_table_find_bucket_in(table->old_buckets, table->old_capacity, hashed_key));
+    }
+
+    // Find target index.
+    hash_table_entry **entry = hash_table_find_bucket_in(table->buckets, table->capacity, hashed_key);
+    hash_table_entry **first_entry = entry;
+
+    // Collision occurred.
+    if (*entry != NULL)
+    {
+        table->collisions++;
+        trace_collision(table->options.trace, TRACE_ADD_COLLISION, (*first_entry)->key, (*first_entry)->key_size, key, key_size);
+    }
+
+    // Update the first entry to the newly created entry and link to next.
+    new_entry->next = *entry;
+    *entry = new_entry;
+    table->entries++;
+    bloom_filter_add(&table->bloom, hashed_key);
+
+    // Grow the table once it becomes too crowded.
+    if (table->options.rehash_mode != HASH_TABLE_REHASH_NONE &&
+        (float)table->entries / (float)table->capacity > table->options.max_load_factor)
+    {
+        hash_table_grow(table);
+    }
+}
+
+/**
+ * Adds an entry to the hash table.
+ */
+void hash_table_add(hash_table *table, void *key, size_t key_size, void *value)
+{
+    hash_table_add_hashed(table, hash_table_hash(table, key, key_size), key, key_size, value);
+}
+
+/**
+ * Grows the bucket array so the table fits the number of entries within its max load factor,
+ * moving every entry at once. Does nothing if the table already fits them, or never grows.
+ * The capacity is the one adding the entries one by one grows to, so the buckets and the Bloom filter
+ * are sized the same whether the table is built in parallel or not.
+ */
+void hash_table_reserve(hash_table *table, size_t entries)
+{
+    if (table->options.rehash_mode == HASH_TABLE_REHASH_NONE ||
+        (float)entries / (float)table->capacity <= table->options.max_load_factor)
+    {
+        return;
+    }
+    hash_table_rehash_step(table, table->old_capacity);
+
+    table->old_buckets = table->buckets;
+    table->old_capacity = table->capacity;
+    table->rehash_index = 0;
+    while ((float)entries / (float)table->capacity > table->options.max_load_factor)
+    {
+        table->capacity = next_prime(table->capacity * 2 + 1);
+    }
+    table->buckets = (hash_table_entry **)large_alloc(table->capacity * sizeof(hash_table_entry *), &table->options.memory);
+    table->old_bloom = table->bloom;
+    table->bloom = hash_table_bloom_create(table);
+    table->rehashes++;
+    hash_table_rehash_step(table, table->old_capacity);
+}
+
+/**
+ * The shared state of a parallel add. The source range of thread t is the keys from
+ * t * n / threads, and its partition is the buckets from t * capacity / threads,
+ * and the Bloom filter blocks from t * block_count / threads.
+ */
+typedef struct
+{
+    hash_table *table;
+    void *const *keys;
+    const size_t *sizes;
+    void *const *values;
+    size_t n;
+    int threads;
+    uint64_t *hashes;
+    // counts[source * threads + partition] is the number of keys from the source range in the partition,
+    // turned into the offset in 'order' where the source writes the indices of those keys
+    size_t *counts;
+    size_t *order;
+    // The same for the partitions of the Bloom filter blocks, or NULL if the table has no filter
+    size_t *filter_counts;
+    size_t *filter_order;
+    // Every new entry, if the allocator frees in bulk, otherwise NULL and entries are allocated one by one
+    hash_table_entry *block;
+    size_t *collisions;
+} parallel_add;
+
+typedef enum
+{
+    PARALLEL_HASH,
+    PARALLEL_SCATTER,
+    PARALLEL_LINK,
+    PARALLEL_FILTER,
+} parallel_add_phase;
+
+typedef struct
+{
+    parallel_add *add;
+    int thread;
+    parallel_add_phase phase;
+} parallel_add_job;
+
+size_t parallel_add_partition(const parallel_add *add, uint64_t hash)
+{
+    return (hash % add->table->capacity) * add->threads / add->table->capacity;
+}
+
+size_t parallel_add_filter_partition(const parallel_add *add, uint64_t hash)
+{
+    const bloom_filter *filter = &add->table->bloom;
+    return bloom_filter_block_index(filter, hash) * add->threads / filter->block_count;
+}
+
+/**
+ * Turns the counts of every source in every partition into offsets, laying the partitions out one after another
+ * and every source's part of a partition in source order.
+ */
+void parallel_add_offsets(size_t *counts, int threads)
+{
+    size_t offset = 0;
+    for (int partition = 0; partition < threads; partition++)
+    {
+        for (int source = 0; source < threads; source++)
+        {
+            size_t count = counts[source * threads + partition];
+            counts[source * threads + partition] = offset;
+            offset += count;
+        }
+    }
+}
+
+/**
+ * Gets where the partition is in the order, once every source has scattered its keys.
+ * The partition then ends where the last source's slice of it ends.
+ */
+void parallel_add_slice(const size_t *counts, int threads, int partition, size_t *start, size_t *end)
+{
+    *start = partition == 0 ? 0 : counts[(threads - 1) * threads + partition - 1];
+    *end = counts[(threads - 1) * threads + partition];
+}
+
+void *parallel_add_run(void *arg)
+{
+    parallel_add_job *job = (parallel_add_job *)arg;
+    parallel_add *add = job->add;
+    hash_table *table = add->table;
+    size_t from = job->thread * add->n / add->threads;
+    size_t to = (job->thread + 1) * add->n / add->threads;
+    size_t *counts = &add->counts[job->thread * add->threads];
+    size_t *filter_counts = add->filter_counts != NULL ? &add->filter_counts[job->thread * add->threads] : NULL;
+
+    switch (job->phase)
+    {
+    case PARALLEL_HASH:
+        for (size_t i = from; i < to; i++)
+        {
+            add->hashes[i] = hash_table_hash(table, add->keys[i], add->sizes[i]);
+            counts[parallel_add_partition(add, add->hashes[i])]++;
+            if (filter_counts != NULL)
+            {
+                filter_counts[parallel_add_filter_partition(add, add->hashes[i])]++;
+            }
+        }
+        break;
+    case PARALLEL_SCATTER:
+        for (size_t i = from; i < to; i++)
+        {
+            add->order[counts[parallel_add_partition(add, add->hashes[i])]++] = i;
+            if (filter_counts != NULL)
+            {
+                add->filter_order[filter_counts[parallel_add_filter_partition(add, add->hashes[i])]++] = i;
+            }
+        }
+        break;
+    case PARALLEL_LINK:
+    {
+        size_t start, end;
+        parallel_add_slice(add->counts, add->threads, job->thread, &start, &end);
+        size_t collisions = 0;
+        for (size_t k = start; k < end; k++)
+        {
+            size_t i = add->order[k];
+            hash_table_entry *entry = add->block != NULL ? &add->block[i] : table->allocator.alloc(table->allocator.ctx, sizeof(hash_table_entry));
+            hash_table_entry_set_key(table, entry, add->hashes[i], add->keys[i], add->sizes[i]);
+            entry->value = add->values[i];
+            hash_table_entry **bucket = hash_table_find_bucket_in(table->buckets, table->capacity, add->hashes[i]);
+            if (*bucket != NULL)
+            {
+                collisions++;
+                trace_collision(table->options.trace, TRACE_ADD_COLLISION, (*bucket)->key, (*bucket)->key_size, entry->key, entry->key_size);
+            }
+            entry->next = *bucket;
+            *bucket = entry;
+        }
+        add->collisions[job->thread] = collisions;
+        break;
+    }
+    case PARALLEL_FILTER:
+    {
+        // Every thread sets the bits of its own range of blocks
+        size_t start, end;
+        parallel_add_slice(add->filter_counts, add->threads, job->thread, &start, &end);
+        for (size_t k = start; k < end; k++)
+        {
+            bloom_filter_add(&table->bloom, add->hashes[add->filter_order[k]]);
+        }
+        break;
+    }
+    }
+    return NULL;
+}
+
+/**
+ * Adds n entries to the hash table on a number of threads. A lookup finds the same entries as after adding
+ * them one by one in order, but the statistics differ: the table grows to fit every entry up front, so the
+ * collisions are only counted in the final buckets and not in the smaller tables a one by one build passes.
+ * The keys are hashed in parallel and partitioned by bucket, so every thread links the entries of its own
+ * range of buckets without any locks, and in the order they were given. The Bloom filter is partitioned by
+ * block the same way.
+ * Entries are allocated in one block if the table's allocator frees in bulk (like the arena), otherwise
+ * one at a time, so an allocator with a free function must be thread-safe.
+ * Keys that the table copies into its string arena are copied up front, on the calling thread.
+ */
+void hash_table_add_parallel(hash_table *table, void *const keys[], const size_t sizes[], void *const values[], size_t n, int threads)
+{
+    hash_table_reserve(table, table->entries + n);
+    hash_table_rehash_step(table, table->old_capacity);
+
+    void **owned_keys = NULL;
+    if (table->options.key_storage == HASH_TABLE_KEYS_COPIED)
+    {
+        owned_keys = malloc(n * sizeof(void *) + 1);
+        for (size_t i = 0; i < n; i++)
+        {
+            owned_keys[i] = hash_table_own_key(table, keys[i], sizes[i]);
+        }
+        keys = owned_keys;
+    }
+
+    parallel_add add = {
+        .table = table,
+        .keys = keys,
+        .sizes = sizes,
+        .values = values,
+        .n = n,
+        .threads = threads,
+        .hashes = malloc(n * sizeof(uint64_t) + 1),
+        .counts = calloc(threads * threads, sizeof(size_t)),
+        .order = malloc(n * sizeof(size_t) + 1),
+        .filter_counts = table->bloom.blocks != NULL ? calloc(threads * threads, sizeof(size_t)) : NULL,
+        .filter_order = table->bloom.blocks != NULL ? malloc(n * sizeof(size_t) + 1) : NULL,
+        .block = table->allocator.free == NULL ? table->allocator.alloc(table->allocator.ctx, n * sizeof(hash_table_entry) + 1) : NULL,
+        .collisions = calloc(threads, sizeof(size_t)),
+    };
+    parallel_add_job *jobs = malloc(threads * sizeof(parallel_add_job));
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t] = (parallel_add_job){&add, t, PARALLEL_HASH};
+    }
+    run_threads(threads, &parallel_add_run, jobs, sizeof(parallel_add_job));
+
+    parallel_add_offsets(add.counts, threads);
+    if (add.filter_counts != NULL)
+    {
+        parallel_add_offsets(add.filter_counts, threads);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t].phase = PARALLEL_SCATTER;
+    }
+    run_threads(threads, &parallel_add_run, jobs, sizeof(parallel_add_job));
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t].phase = PARALLEL_LINK;
+    }
+    run_threads(threads, &parallel_add_run, jobs, sizeof(parallel_add_job));
+    if (add.filter_counts != NULL)
+    {
+        for (int t = 0; t < threads; t++)
+        {
+            jobs[t].phase = PARALLEL_FILTER;
+        }
+        run_threads(threads, &parallel_add_run, jobs, sizeof(parallel_add_job));
+    }
+
+    table->entries += n;
+    for (int t = 0; t < threads; t++)
+    {
+        table->collisions += add.collisions[t];
+    }
+    free(jobs);
+    free(add.hashes);
+    free(add.counts);
+    free(add.order);
+    free(add.filter_counts);
+    free(add.filter_order);
+    free(add.collisions);
+    free(owned_keys);
+}
+
+/**
+ * Finds the entry with the key in the chain starting at first_entry, or returns NULL.
+ * The number of entries passed before it is written to depth. Nothing in the table is changed.
+ */
+hash_table_entry *hash_table_find_entry(hash_table_entry *first_entry, uint64_t hashed_key, const void *key, size_t key_size, size_t *depth)
+{
+    hash_table_entry *entry = first_entry;
+
+    // Multiple keys can have same hash!
+    // We need to find the entry with precisely the same key.
+    *depth = 0;
+    while (entry != NULL)
+    {
+        // We have found a match if hash, key size and key contents are equal.
+        // The key contents are only compared when the hashes already match.
+        if (entry->hash == hashed_key && entry->key_size == key_size && memcmp(entry->key, key, key_size) == 0)
+        {
+            return entry;
+        }
+
+        entry = entry->next;
+        (*depth)++;
+    }
+    return NULL;
+}
+
+/**
+ * Checks the Bloom filters of the table. Returns false if the key is certainly not in the table.
+ * Nothing in the table is changed.
+ */
+bool hash_table_may_contain(const hash_table *table, uint64_t hashed_key)
+{
+    return bloom_filter_contains(&table->bloom, hashed_key) ||
+           (table->old_buckets != NULL && bloom_filter_contains(&table->old_bloom, hashed_key));
+}
+
+/**
+ * Searches the chain starting at first_entry for the key, and writes its value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ * The chain is not walked at all if the Bloom filter rules the key out.
+ */
+bool hash_table_search_chain(hash_table *table, hash_table_entry *first_entry, uint64_t hashed_key, void *key, size_t key_size, void **value)
+{
+    if (!hash_table_may_contain(table, hashed_key))
+    {
+        table->bloom_rejects++;
+        lookup_stats_record(&table->lookup_stats, false, 0);
+        return false;
+    }
+
+    size_t depth;
+    hash_table_entry *entry = hash_table_find_entry(first_entry, hashed_key, key, key_size, &depth);
+    bool found = entry != NULL;
+    if (found)
+    {
+        *value = entry->value;
+    }
+    else if (table->bloom.blocks != NULL)
+    {
+        table->bloom_false_positives++;
+    }
+
+    lookup_stats_record(&table->lookup_stats, found, depth);
+    if (found && first_entry != entry)
+    {
+        trace_collision(table->options.trace, TRACE_LOOKUP_COLLISION, entry->key, entry->key_size, first_entry->key, first_entry->key_size);
+    }
+
+    return found;
+}
+
+/**
+ * Performs lookup in the hash table based on the key and writes the value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ */
+bool hash_table_lookup(hash_table *table, void *key, size_t key_size, void **value)
+{
+    hash_table_rehash_step(table, table->options.rehash_step);
+
+    // Find target index.
+    uint64_t hashed_key = hash_table_hash(table, key, key_size);
+    hash_table_entry *entry = *hash_table_find_bucket(table, hashed_key);
+    return hash_table_search_chain(table, entry, hashed_key, key, key_size, value);
+}
+
+#define LOOKUP_BATCH_SIZE 16
+
+/**
+ * Performs lookup of n keys. The value of keys[i] is written to values_out[i] and found_out[i] tells if it was found.
+ * 
+ * The keys are processed in groups. All hashes of a group are computed first, then the buckets and first entries
+ * are prefetched, and only then are the chains searched. That way the cache misses of a group overlap
+ * instead of being paid one after the other.
+ */
+void hash_table_lookup_batch(hash_table *table, void *const keys[], const size_t sizes[], size_t n, void *values_out[], bool found_out[])
+{
+    hash_table_entry **buckets[LOOKUP_BATCH_SIZE];
+    uint64_t hashes[LOOKUP_BATCH_SIZE];
+    for (size_t base = 0; base < n; base += LOOKUP_BATCH_SIZE)
+    {
+        size_t count = n - base < LOOKUP_BATCH_SIZE ? n - base : LOOKUP_BATCH_SIZE;
+        // Migrating buckets moves entries around, so it must not happen while the group is in flight.
+        hash_table_rehash_step(table, table->options.rehash_step);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            hashes[i] = hash_table_hash(table, keys[base + i], sizes[base + i]);
+            buckets[i] = hash_table_find_bucket(table, hashes[i]);
+            __builtin_prefetch(buckets[i]);
+            if (table->bloom.blocks != NULL)
+            {
+                __builtin_prefetch(bloom_filter_block(&table->bloom, hashes[i]));
+            }
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            if (*buckets[i] != NULL)
+            {
+                __builtin_prefetch(*buckets[i]);
+            }
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            found_out[base + i] = hash_table_search_chain(table, *buckets[i], hashes[i], keys[base + i], sizes[base + i], &values_out[base + i]);
+        }
+    }
+}
+
+/**
+ * Gets the number of entries in the hash table. 
+ */
+size_t hash_table_entries(hash_table *table)
+{
+    return table->entries;
+}
+
+/**
+ * Gets the load factor (entries / capacity) of the hash table.
+ */
+float hash_table_load_factor(hash_table *table)
+{
+    return (float)table->entries / (float)table->capacity;
+}
+
+/**
+ * Gets the number of collisions in the hash table.
+ */
+size_t hash_table_collisions(hash_table *table)
+{
+    return table->collisions;
+}
+
+/**
+ * Gets the number of buckets in the hash table.
+ */
+size_t hash_table_capacity(hash_table *table)
+{
+    return table->capacity;
+}
+
+/**
+ * Gets the number of times the hash table has grown.
+ */
+size_t hash_table_rehashes(hash_table *table)
+{
+    return table->rehashes;
+}
+
+/**
+ * Gets the lookup statistics of the hash table.
+ */
+const lookup_stats *hash_table_lookup_stats(hash_table *table)
+{
+    return &table->lookup_stats;
+}
+
+/**
+ * Gets the share of lookups of missing keys that got past the Bloom filter, or 0 if there were none.
+ */
+double hash_table_bloom_false_positive_rate(hash_table *table)
+{
+    size_t misses = table->bloom_rejects + table->bloom_false_positives;
+    return misses > 0 ? (double)table->bloom_false_positives / (double)misses : 0.0;
+}
+
+/***************************************
+ * Sharded table implementation        *
+ ***************************************/
+
+/**
+ * The sharded table splits the keys over a power-of-two number of hash tables, picked by the high bits
+ * of the hash. Each shard has its own bucket array and reader-writer lock, so adds and lookups from
+ * many threads only contend when they land in the same shard, and a shard grows without stopping the others.
+ *
+ * Lookups hold the read lock and never change the shard, which is why the shards always rehash
+ * the whole bucket array at once: an incremental rehash moves entries on every lookup.
+ * A seqlock would let readers skip the shared lock word, but a reader could then still be walking
+ * a bucket array that the writer has just freed.
+ */
+
+/**
+ * A shard of the sharded table, kept on its own cache lines. The lookup statistics are counted
+ * with relaxed atomics, since many readers update them at once.
+ */
+typedef struct
+{
+    _Alignas(64) pthread_rwlock_t lock;
+    hash_table *table;
+    atomic_size_t lookups;
+    atomic_size_t hits;
+    atomic_size_t depth[LOOKUP_DEPTH_BUCKETS];
+    // Misses the shard's Bloom filter ruled out, and misses it let through
+    atomic_size_t bloom_rejects;
+    atomic_size_t bloom_false_positives;
+} table_shard;
+
+typedef struct
+{
+    unsigned int shard_bits;
+    size_t shard_count;
+    table_shard *shards;
+    hash_func *hash;
+    uint64_t seed;
+    // Filled in from the shards by sharded_table_lookup_stats
+    lookup_stats lookup_stats;
+} sharded_table;
+
+/**
+ * Creates a sharded table with the total capacity spread over options->shards shards.
+ * If options is NULL, the default options are used. The allocator in the options is called from every shard,
+ * so it must be thread-safe if the table is written from several threads. Without one, every shard gets its own arena.
+ */
+sharded_table *sharded_table_create(size_t capacity, const hash_table_options *options)
+{
+    sharded_table *table = (sharded_table *)calloc(1, sizeof(sharded_table));
+    hash_table_options shard_options = options != NULL ? *options : hash_table_default_options();
+    while (((size_t)1 << table->shard_bits) < shard_options.shards)
+    {
+        table->shard_bits++;
+    }
+    size_t shard_count = (size_t)1 << table->shard_bits;
+    table->shard_count = shard_count;
+
+    if (shard_options.rehash_mode == HASH_TABLE_REHASH_INCREMENTAL)
+    {
+        shard_options.rehash_mode = HASH_TABLE_REHASH_FULL;
+    }
+    if (shard_options.hash == NULL)
+    {
+        shard_options.hash = hash_algorithm_best()->func;
+    }
+    table->hash = shard_options.hash;
+    table->seed = shard_options.seed;
+
+    size_t shard_capacity = next_prime(capacity / shard_count + 1);
+    table->shards = (table_shard *)aligned_alloc(_Alignof(table_shard), shard_count * sizeof(table_shard));
+    memset(table->shards, 0, shard_count * sizeof(table_shard));
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        pthread_rwlock_init(&table->shards[i].lock, NULL);
+        table->shards[i].table = hash_table_create(shard_capacity, &shard_options);
+    }
+    return table;
+}
+
+void sharded_table_free(sharded_table *table)
+{
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        hash_table_free(table->shards[i].table);
+        pthread_rwlock_destroy(&table->shards[i].lock);
+    }
+    free(table->shards);
+    free(table);
+}
+
+/**
+ * Remixes the hash before picking the shard. Some hash functions, like rotxor, only set the low 32 bits,
+ * and the Bloom filters pick their blocks from the plain mix64 of the hash, which must stay independent of the shard.
+ */
+#define SHARD_MIX_SEED 0xd6e8feb86659fd93ull
+
+/**
+ * Gets the shard the hashed key belongs to, from the high bits of a remix of the hash. The bucket index
+ * within the shard is taken modulo a prime, so it still depends on every bit of the hash.
+ */
+table_shard *sharded_table_shard(sharded_table *table, uint64_t hash)
+{
+    return &table->shards[table->shard_bits > 0 ? typed_mix64(hash ^ SHARD_MIX_SEED) >> (64 - table->shard_bits) : 0];
+}
+
+/**
+ * Adds an entry to the table. Safe to call concurrently with other adds and lookups.
+ */
+void sharded_table_add(sharded_table *table, void *key, size_t key_size, void *value)
+{
+    uint64_t hash = table->hash(key, key_size, table->seed);
+    table_shard *shard = sharded_table_shard(table, hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    hash_table_add_hashed(shard->table, hash, key, key_size, value);
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+/**
+ * Performs lookup in the table and writes the value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ * Safe to call concurrently with other adds and lookups.
+ */
+bool sharded_table_lookup(sharded_table *table, void *key, size_t key_size, void **value)
+{
+    uint64_t hash = table->hash(key, key_size, table->seed);
+    table_shard *shard = sharded_table_shard(table, hash);
+    size_t depth = 0;
+    hash_table_entry *entry = NULL;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    bool may_contain = hash_table_may_contain(shard->table, hash);
+    bool filtered = shard->table->bloom.blocks != NULL;
+    if (may_contain)
+    {
+        entry = hash_table_find_entry(*hash_table_find_bucket(shard->table, hash), hash, key, key_size, &depth);
+    }
+    if (entry != NULL)
+    {
+        *value = entry->value;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (!may_contain)
+    {
+        atomic_fetch_add_explicit(&shard->bloom_rejects, 1, memory_order_relaxed);
+    }
+    else if (entry == NULL && filtered)
+    {
+        atomic_fetch_add_explicit(&shard->bloom_false_positives, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&shard->lookups, 1, memory_order_relaxed);
+    if (entry != NULL)
+    {
+        atomic_fetch_add_explicit(&shard->hits, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shard->depth[depth < LOOKUP_DEPTH_BUCKETS - 1 ? depth : LOOKUP_DEPTH_BUCKETS - 1], 1, memory_order_relaxed);
+    }
+    return entry != NULL;
+}
+
+void sharded_table_lookup_batch(sharded_table *table, void *const keys[], const size_t sizes[], size_t n, void *values_out[], bool found_out[])
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        found_out[i] = sharded_table_lookup(table, keys[i], sizes[i], &values_out[i]);
+    }
+}
+
+/**
+ * Sums a counter of the hash tables of every shard, each read under its shard's lock.
+ */
+size_t sharded_table_sum(sharded_table *table, size_t (*counter)(hash_table *))
+{
+    size_t sum = 0;
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        pthread_rwlock_rdlock(&table->shards[i].lock);
+        sum += counter(table->shards[i].table);
+        pthread_rwlock_unlock(&table->shards[i].lock);
+    }
+    return sum;
+}
+
+/**
+ * Gets the number of entries in every shard.
+ */
+size_t sharded_table_entries(sharded_table *table)
+{
+    return sharded_table_sum(table, &hash_table_entries);
+}
+
+/**
+ * Gets the load factor (entries / capacity) over every shard.
+ */
+float sharded_table_load_factor(sharded_table *table)
+{
+    return (float)sharded_table_entries(table) / (float)sharded_table_sum(table, &hash_table_capacity);
+}
+
+/**
+ * Gets the number of collisions in every shard.
+ */
+size_t sharded_table_collisions(sharded_table *table)
+{
+    return sharded_table_sum(table, &hash_table_collisions);
+}
+
+/**
+ * Gets the number of buckets in every shard.
+ */
+size_t sharded_table_capacity(sharded_table *table)
+{
+    return sharded_table_sum(table, &hash_table_capacity);
+}
+
+/**
+ * Gets the number of times any shard has grown.
+ */
+size_t sharded_table_rehashes(sharded_table *table)
+{
+    return sharded_table_sum(table, &hash_table_rehashes);
+}
+
+/**
+ * Gets the lookup statistics summed over every shard.
+ * The result is only updated by this call, so it must not be called from several threads at once.
+ */
+const lookup_stats *sharded_table_lookup_stats(sharded_table *table)
+{
+    lookup_stats *stats = &table->lookup_stats;
+    memset(stats, 0, sizeof(lookup_stats));
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        table_shard *shard = &table->shards[i];
+        stats->lookups += atomic_load_explicit(&shard->lookups, memory_order_relaxed);
+        stats->hits += atomic_load_explicit(&shard->hits, memory_order_relaxed);
+        for (int d = 0; d < LOOKUP_DEPTH_BUCKETS; d++)
+        {
+            stats->depth[d] += atomic_load_explicit(&shard->depth[d], memory_order_relaxed);
+        }
+    }
+    return stats;
+}
+
+/**
+ * Gets the misses the Bloom filters of every shard ruled out, and the misses they let through.
+ */
+void sharded_table_bloom_counts(sharded_table *table, size_t *rejects, size_t *false_positives)
+{
+    *rejects = *false_positives = 0;
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        *rejects += atomic_load_explicit(&table->shards[i].bloom_rejects, memory_order_relaxed);
+        *false_positives += atomic_load_explicit(&table->shards[i].bloom_false_positives, memory_order_relaxed);
+    }
+}
+
+/**
+ * Gets the total number of blocks of the Bloom filters of every shard.
+ */
+size_t sharded_table_bloom_blocks(sharded_table *table)
+{
+    size_t blocks = 0;
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        pthread_rwlock_rdlock(&table->shards[i].lock);
+        blocks += table->shards[i].table->bloom.block_count;
+        pthread_rwlock_unlock(&table->shards[i].lock);
+    }
+    return blocks;
+}
+
+/***************************************
+ * Table snapshots                     *
+ ***************************************/
+
+/**
+ * A snapshot is a chained hash table written to a file in a position-independent layout, which can be
+ * mapped read-only and used for lookups without any deserialization. Processes mapping the same snapshot
+ * share its pages in the page cache.
+ *
+ * The file starts with a snapshot_header, followed by the bucket array, the entries and the string heap.
+ * A bucket holds the file offset of the first entry of its chain, and an entry holds the offsets of the
+ * next entry and of its key in the string heap. Offset 0 is the header, so it marks the end of a chain.
+ * The entries of a chain are stored next to each other. Values are stored as they are, so only values
+ * that are not pointers (like person IDs) survive a snapshot.
+ *
+ * Integers are stored in the byte order of the machine that wrote the snapshot; entry_size and the
+ * byte order mark reject snapshots written by a different layout or byte order.
+ */
+#define SNAPSHOT_MAGIC "NAMESNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x0102030405060708ull
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t byte_order;
+    uint64_t file_size;
+    uint64_t capacity;
+    uint64_t entries;
+    uint64_t collisions;
+    uint64_t seed;
+    char hash_name[16];
+    uint64_t buckets_offset;
+    uint64_t entries_offset;
+    uint64_t heap_offset;
+} snapshot_header;
+
+typedef struct
+{
+    uint64_t hash;
+    uint64_t next;
+    uint64_t key;
+    uint64_t key_size;
+    uint64_t value;
+} snapshot_entry;
+
+/**
+ * hash_table_snapshot is a snapshot mapped into memory.
+ */
+typedef struct
+{
+    const uint8_t *base;
+    size_t size;
+    const snapshot_header *header;
+    const uint64_t *buckets;
+    hash_func *hash;
+    lookup_stats lookup_stats;
+} hash_table_snapshot;
+
+/**
+ * Gets the hash algorithm with the function, or NULL if it is not one of hash_algorithms.
+ */
+const hash_algorithm *hash_algorithm_of(hash_func *func)
+{
+    for (int i = 0; i < hash_algorithms_length; i++)
+    {
+        if (hash_algorithms[i].func == func)
+        {
+            return &hash_algorithms[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Writes a snapshot of the table to the file. Any incremental rehash in progress is finished first.
+ * The file is written under a temporary name and renamed, so readers never see a partial snapshot.
+ * Returns false and prints the reason if the snapshot could not be written.
+ */
+bool hash_table_save(hash_table *table, const char *path)
+{
+    const hash_algorithm *algorithm = hash_algorithm_of(table->options.hash);
+    if (algorithm == NULL)
+    {
+        fprintf(stderr, "Only tables using one of the built-in hash functions can be saved.\n");
+        return false;
+    }
+    hash_table_rehash_step(table, table->old_capacity);
+
+    size_t heap_size = 0;
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        for (hash_table_entry *entry = table->buckets[i]; entry != NULL; entry = entry->next)
+        {
+            heap_size += entry->key_size;
+        }
+    }
+
+    snapshot_header header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .entry_size = sizeof(snapshot_entry),
+        .byte_order = SNAPSHOT_BYTE_ORDER,
+        .capacity = table->capacity,
+        .entries = table->entries,
+        .collisions = table->collisions,
+        .seed = table->options.seed,
+        .buckets_offset = sizeof(snapshot_header),
+    };
+    snprintf(header.hash_name, sizeof(header.hash_name), "%s", algorithm->name);
+    header.entries_offset = header.buckets_offset + table->capacity * sizeof(uint64_t);
+    header.heap_offset = header.entries_offset + table->entries * sizeof(snapshot_entry);
+    header.file_size = header.heap_offset + heap_size;
+
+    uint64_t *buckets = calloc(table->capacity, sizeof(uint64_t));
+    snapshot_entry *entries = malloc(table->entries * sizeof(snapshot_entry) + 1);
+    size_t n = 0;
+    uint64_t key_offset = header.heap_offset;
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        for (hash_table_entry *entry = table->buckets[i]; entry != NULL; entry = entry->next, n++)
+        {
+            uint64_t offset = header.entries_offset + n * sizeof(snapshot_entry);
+            if (entry == table->buckets[i])
+            {
+                buckets[i] = offset;
+            }
+            entries[n] = (snapshot_entry){
+                .hash = entry->hash,
+                .next = entry->next != NULL ? offset + sizeof(snapshot_entry) : 0,
+                .key = key_offset,
+                .key_size = entry->key_size,
+                .value = (uint64_t)(uintptr_t)entry->value,
+            };
+            key_offset += entry->key_size;
+        }
+    }
+
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    bool ok = file != NULL &&
+              fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(buckets, sizeof(uint64_t), table->capacity, file) == table->capacity &&
+              fwrite(entries, sizeof(snapshot_entry), n, file) == n;
+    for (size_t i = 0; ok && i < table->capacity; i++)
+    {
+        for (hash_table_entry *entry = table->buckets[i]; ok && entry != NULL; entry = entry->next)
+        {
+            ok = fwrite(entry->key, 1, entry->key_size, file) == entry->key_size;
+        }
+    }
+    if (file != NULL)
+    {
+        ok = fclose(file) == 0 && ok;
+    }
+    ok = ok && rename(temp_path, path) == 0;
+    if (!ok)
+    {
+        perror("Unable to write snapshot");
+        remove(temp_path);
+    }
+    free(buckets);
+    free(entries);
+    return ok;
+}
+
+/**
+ * Maps a snapshot written by hash_table_save read-only. Only the header is checked, so opening takes the
+ * same time for every snapshot size; lookups check the offsets they follow.
+ * Returns NULL and prints the reason if the file is not a usable snapshot.
+ */
+hash_table_snapshot *hash_table_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror("Unable to open snapshot");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    const uint8_t *base = size >= sizeof(snapshot_header) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map snapshot '%s'.\n", path);
+        return NULL;
+    }
+
+    const snapshot_header *header = (const snapshot_header *)base;
+    const hash_algorithm *algorithm = NULL;
+    for (int i = 0; i < hash_algorithms_length; i++)
+    {
+        if (strncmp(hash_algorithms[i].name, header->hash_name, sizeof(header->hash_name)) == 0)
+        {
+            algorithm = &hash_algorithms[i];
+        }
+    }
+    const char *error = NULL;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+    {
+        error = "not a snapshot";
+    }
+    else if (header->version != SNAPSHOT_VERSION || header->entry_size != sizeof(snapshot_entry) ||
+             header->byte_order != SNAPSHOT_BYTE_ORDER)
+    {
+        error = "written by an incompatible version or machine";
+    }
+    // Every count is checked against what is left of the file before it is multiplied or added,
+    // so a crafted header cannot wrap the offsets around to something that looks in bounds
+    else if (header->file_size != size || header->capacity == 0 ||
+             header->buckets_offset != sizeof(snapshot_header) ||
+             header->capacity > (size - header->buckets_offset) / sizeof(uint64_t) ||
+             header->entries_offset != header->buckets_offset + header->capacity * sizeof(uint64_t) ||
+             header->entries > (size - header->entries_offset) / sizeof(snapshot_entry) ||
+             header->heap_offset != header->entries_offset + header->entries * sizeof(snapshot_entry))
+    {
+        error = "truncated or corrupt";
+    }
+    else if (algorithm == NULL || !algorithm->available())
+    {
+        error = "its hash function is not supported on this machine";
+    }
+    if (error != NULL)
+    {
+        fprintf(stderr, "Unable to use snapshot '%s': %s.\n", path, error);
+        munmap((void *)base, size);
+        return NULL;
+    }
+
+    hash_table_snapshot *snapshot = calloc(1, sizeof(hash_table_snapshot));
+    snapshot->base = base;
+    snapshot->size = size;
+    snapshot->header = header;
+    snapshot->buckets = (const uint64_t *)(base + header->buckets_offset);
+    snapshot->hash = algorithm->func;
+    return snapshot;
+}
+
+void hash_table_snapshot_close(hash_table_snapshot *snapshot)
+{
+    munmap((void *)snapshot->base, snapshot->size);
+    free(snapshot);
+}
+
+/**
+ * Gets the entry at the offset, or NULL if the offset ends the chain or is not an entry of the snapshot.
+ */
+const snapshot_entry *hash_table_snapshot_entry(const hash_table_snapshot *snapshot, uint64_t offset)
+{
+    const snapshot_header *header = snapshot->header;
+    if (offset < header->entries_offset || offset >= header->heap_offset ||
+        (offset - header->entries_offset) % sizeof(snapshot_entry) != 0)
+    {
+        return NULL;
+    }
+    return (const snapshot_entry *)(snapshot->base + offset);
+}
+
+/**
+ * Performs lookup in the snapshot based on the key and writes the value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ */
+bool hash_table_snapshot_lookup(hash_table_snapshot *snapshot, const void *key, size_t key_size, void **value)
+{
+    uint64_t hash = snapshot->hash(key, key_size, snapshot->header->seed);
+    const snapshot_entry *entry = hash_table_snapshot_entry(snapshot, snapshot->buckets[hash % snapshot->header->capacity]);
+    size_t depth = 0;
+    // A corrupt snapshot could link a chain into a loop, which can never be longer than every entry
+    for (; entry != NULL && depth < snapshot->header->entries; entry = hash_table_snapshot_entry(snapshot, entry->next), depth++)
+    {
+        if (entry->hash == hash && entry->key_size == key_size && key_size <= snapshot->size &&
+            entry->key <= snapshot->size - key_size &&
+            entry->key >= snapshot->header->heap_offset && memcmp(snapshot->base + entry->key, key, key_size) == 0)
+        {
+            *value = (void *)(uintptr_t)entry->value;
+            lookup_stats_record(&snapshot->lookup_stats, true, depth);
+            return true;
+        }
+    }
+    lookup_stats_record(&snapshot->lookup_stats, false, depth);
+    return false;
+}
+
+/***************************************
+ * Swiss table implementation          *
+ ***************************************/
+
+/**
+ * The swiss table is an open-addressing table. Every slot has a control byte, and the control bytes are
+ * grouped 16 at a time so a whole group can be matched against a key with a single SIMD compare.
+ * 
+ * A control byte is either SWISS_EMPTY or the 7-bit tag (the low bits of the hash) of the key in the slot.
+ * The rest of the hash selects the group where probing starts. Every slot also stores the full hash,
+ * so a tag match with a different key is almost always rejected without calling memcmp.
+ */
+#define SWISS_GROUP_SIZE 16
+const uint8_t SWISS_EMPTY = 0x80;
+const float SWISS_MAX_LOAD_FACTOR = 0.875f;
+
+/**
+ * swiss_table_slot is a key-value-pair in the swiss table, along with the hash of the key.
+ */
+typedef struct
+{
+    uint64_t hash;
+    void *key;
+    size_t key_size;
+    void *value;
+} swiss_table_slot;
+
+/**
+ * swiss_table represents a swiss table.
+ * The capacity is a power of two, and at least one group.
+ */
+typedef struct
+{
+    size_t entries;
+    size_t capacity;
+    size_t collisions;
+    size_t rehashes;
+    lookup_stats lookup_stats;
+    uint8_t *ctrl;
+    swiss_table_slot *slots;
+
+    hash_func *hash;
+    uint64_t seed;
+    memory_options memory;
+} swiss_table;
+
+/**
+ * Gets a bit mask of the slots in the group whose control byte equals the value.
+ */
+#if defined(__SSE2__)
+unsigned int swiss_group_match(const uint8_t *group, uint8_t value)
+{
+    __m128i ctrl = _mm_load_si128((const __m128i *)group);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+}
+#else
+unsigned int swiss_group_match(const uint8_t *group, uint8_t value)
+{
+    unsigned int mask = 0;
+    for (int i = 0; i < SWISS_GROUP_SIZE; i++)
+    {
+        mask |= (unsigned int)(group[i] == value) << i;
+    }
+    return mask;
+}
+#endif
+
+uint8_t swiss_tag(uint64_t hash)
+{
+    return hash & 0x7f;
+}
+
+/**
+ * Gets the group where probing for the hash starts.
+ */
+size_t swiss_home_group(swiss_table *table, uint64_t hash)
+{
+    return (hash >> 7) & (table->capacity / SWISS_GROUP_SIZE - 1);
+}
+
+/**
+ * Allocates empty control bytes and slots for the capacity.
+ */
+void swiss_table_allocate(swiss_table *table, size_t capacity)
+{
+    table->capacity = capacity;
+    // Large allocations are at least aligned like max_align_t, which covers a group.
+    table->ctrl = (uint8_t *)large_alloc(capacity, &table->memory);
+    memset(table->ctrl, SWISS_EMPTY, capacity);
+    table->slots = (swiss_table_slot *)large_alloc(capacity * sizeof(swiss_table_slot), &table->memory);
+}
+
+/**
+ * Creates a new swiss table that fits at least the specified number of entries without growing.
+ * Only the hash function, seed and memory of the options are used; the table always grows at 7/8 load.
+ */
+swiss_table *swiss_table_create(size_t capacity, const hash_table_options *options)
+{
+    swiss_table *table = (swiss_table *)calloc(1, sizeof(swiss_table));
+    hash_table_options defaults = hash_table_default_options();
+    options = options != NULL ? options : &defaults;
+    table->hash = options->hash != NULL ? options->hash : defaults.hash;
+    table->seed = options->seed;
+    table->memory = options->memory;
+
+    size_t slots = SWISS_GROUP_SIZE;
+    while (slots * SWISS_MAX_LOAD_FACTOR < capacity)
+    {
+        slots *= 2;
+    }
+    swiss_table_allocate(table, slots);
+    return table;
+}
+
+/**
+ * Frees the swiss table.
+ * NOTE: Manually allocated data that is used in entries must be freed manually.
+ */
+void swiss_table_free(swiss_table *table)
+{
+    large_free(table->ctrl);
+    large_free(table->slots);
+    free(table);
+}
+
+/**
+ * Finds an empty slot for the hash. There must be at least one empty slot in the table.
+ * Sets *home to whether the slot is in the home group.
+ */
+size_t swiss_table_find_empty(swiss_table *table, uint64_t hash, bool *home)
+{
+    size_t group_mask = table->capacity / SWISS_GROUP_SIZE - 1;
+    size_t group = swiss_home_group(table, hash);
+    // Triangular probing visits every group once when the number of groups is a power of two.
+    for (size_t step = 1;; group = (group + step++) & group_mask)
+    {
+        unsigned int empty = swiss_group_match(&table->ctrl[group * SWISS_GROUP_SIZE], SWISS_EMPTY);
+        if (empty != 0)
+        {
+            *home = step == 1;
+            return group * SWISS_GROUP_SIZE + __builtin_ctz(empty);
+        }
+    }
+}
+
+/**
+ * Doubles the capacity of the swiss table.
+ * The stored hashes are reused, so no keys are hashed again.
+ */
+void swiss_table_grow(swiss_table *table)
+{
+    uint8_t *old_ctrl = table->ctrl;
+    swiss_table_slot *old_slots = table->slots;
+    size_t old_capacity = table->capacity;
+
+    swiss_table_allocate(table, old_capacity * 2);
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_ctrl[i] != SWISS_EMPTY)
+        {
+            bool home;
+            size_t slot = swiss_table_find_empty(table, old_slots[i].hash, &home);
+            table->ctrl[slot] = old_ctrl[i];
+            table->slots[slot] = old_slots[i];
+        }
+    }
+    table->rehashes++;
+
+    large_free(old_ctrl);
+    large_free(old_slots);
+}
+
+/**
+ * Finds the slot containing the key, or returns -1 if the key is not in the table.
+ * If depth is not NULL, it is set to the number of groups probed before the key was found.
+ */
+ptrdiff_t swiss_table_find(swiss_table *table, uint64_t hash, const void *key, size_t key_size, size_t *depth)
+{
+    size_t group_mask = table->capacity / SWISS_GROUP_SIZE - 1;
+    size_t group = swiss_home_group(table, hash);
+    uint8_t tag = swiss_tag(hash);
+    for (size_t step = 1; step <= group_mask + 1; group = (group + step++) & group_mask)
+    {
+        const uint8_t *ctrl = &table->ctrl[group * SWISS_GROUP_SIZE];
+        for (unsigned int match = swiss_group_match(ctrl, tag); match != 0; match &= match - 1)
+        {
+            size_t slot = group * SWISS_GROUP_SIZE + __builtin_ctz(match);
+            swiss_table_slot *entry = &table->slots[slot];
+            if (entry->hash == hash && entry->key_size == key_size && memcmp(entry->key, key, key_size) == 0)
+            {
+                if (depth != NULL)
+                {
+                    *depth = step - 1;
+                }
+                return (ptrdiff_t)slot;
+            }
+        }
+        // Keys are never removed, so the key would have been placed in this group if it had room.
+        if (swiss_group_match(ctrl, SWISS_EMPTY) != 0)
+        {
+            break;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Adds an entry to the swiss table.
+ * If the key is already in the table its value is replaced, so lookups return the newest value like the chained table.
+ */
+void swiss_table_add(swiss_table *table, void *key, size_t key_size, void *value)
+{
+    if ((float)(table->entries + 1) > (float)table->capacity * SWISS_MAX_LOAD_FACTOR)
+    {
+        swiss_table_grow(table);
+    }
+
+    uint64_t hash = table->hash(key, key_size, table->seed);
+    ptrdiff_t existing = swiss_table_find(table, hash, key, key_size, NULL);
+    if (existing >= 0)
+    {
+        table->slots[existing].value = value;
+        return;
+    }
+
+    bool home;
+    size_t slot = swiss_table_find_empty(table, hash, &home);
+    table->ctrl[slot] = swiss_tag(hash);
+    table->slots[slot] = (swiss_table_slot){
+        .hash = hash,
+        .key = key,
+        .key_size = key_size,
+        .value = value,
+    };
+    table->entries++;
+
+    // The key had to be placed outside of the group it belongs to.
+    if (!home)
+    {
+        table->collisions++;
+    }
+}
+
+/**
+ * Performs lookup of the hashed key and writes the value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ */
+bool swiss_table_lookup_hashed(swiss_table *table, uint64_t hash, void *key, size_t key_size, void **value)
+{
+    size_t depth = 0;
+    ptrdiff_t slot = swiss_table_find(table, hash, key, key_size, &depth);
+    lookup_stats_record(&table->lookup_stats, slot >= 0, depth);
+    if (slot < 0)
+    {
+        return false;
+    }
+    *value = table->slots[slot].value;
+    return true;
+}
+
+/**
+ * Performs lookup in the swiss table based on the key and writes the value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ */
+bool swiss_table_lookup(swiss_table *table, void *key, size_t key_size, void **value)
+{
+    return swiss_table_lookup_hashed(table, table->hash(key, key_size, table->seed), key, key_size, value);
+}
+
+/**
+ * Performs lookup of n keys. The value of keys[i] is written to values_out[i] and found_out[i] tells if it was found.
+ * The hashes of a group of keys are computed first and their home groups prefetched before any of them are probed.
+ */
+void swiss_table_lookup_batch(swiss_table *table, void *const keys[], const size_t sizes[], size_t n, void *values_out[], bool found_out[])
+{
+    uint64_t hashes[LOOKUP_BATCH_SIZE];
+    for (size_t base = 0; base < n; base += LOOKUP_BATCH_SIZE)
+    {
+        size_t count = n - base < LOOKUP_BATCH_SIZE ? n - base : LOOKUP_BATCH_SIZE;
+        for (size_t i = 0; i < count; i++)
+        {
+            hashes[i] = table->hash(keys[base + i], sizes[base + i], table->seed);
+            size_t group = swiss_home_group(table, hashes[i]);
+            __builtin_prefetch(&table->ctrl[group * SWISS_GROUP_SIZE]);
+            __builtin_prefetch(&table->slots[group * SWISS_GROUP_SIZE]);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            found_out[base + i] = swiss_table_lookup_hashed(table, hashes[i], keys[base + i], sizes[base + i], &values_out[base + i]);
+        }
+    }
+}
+
+/**
+ * Gets the number of entries in the swiss table.
+ */
+size_t swiss_table_entries(swiss_table *table)
+{
+    return table->entries;
+}
+
+/**
+ * Gets the load factor (entries / capacity) of the swiss table.
+ */
+float swiss_table_load_factor(swiss_table *table)
+{
+    return (float)table->entries / (float)table->capacity;
+}
+
+/**
+ * Gets the number of entries that could not be placed in their home group.
+ */
+size_t swiss_table_collisions(swiss_table *table)
+{
+    return table->collisions;
+}
+
+/**
+ * Gets the number of slots in the swiss table.
+ */
+size_t swiss_table_capacity(swiss_table *table)
+{
+    return table->capacity;
+}
+
+/**
+ * Gets the number of times the swiss table has grown.
+ */
+size_t swiss_table_rehashes(swiss_table *table)
+{
+    return table->rehashes;
+}
+
+/**
+ * Gets the lookup statistics of the swiss table. The depth is counted in groups.
+ */
+const lookup_stats *swiss_table_lookup_stats(swiss_table *table)
+{
+    return &table->lookup_stats;
+}
+
+/***************************************
+ * Perfect hash implementation         *
+ ***************************************/
+
+/**
+ * perfect_table is a static table indexed by a minimal perfect hash function, built the PTHash way.
+ * Every key is hashed once and falls into a bucket of about PERFECT_BUCKET_SIZE keys. Every bucket gets a
+ * pilot, found by trying pilots until all its keys land on free positions, in a table of positions that ends
+ * up PERFECT_LOAD_FACTOR full. The few keys on positions past the number of keys are remapped to the free
+ * positions before it, so the n keys get exactly the slots 0 to n - 1.
+ * A lookup hashes the key once, reads the pilot of its bucket and compares the key in a single slot.
+ *
+ * Keys are staged by perfect_table_add, and perfect_table_build builds the index once every key is there.
+ * A key added more than once keeps its last value, like the newest entry the chained table finds.
+ */
+#define PERFECT_BUCKET_SIZE 5
+#define PERFECT_LOAD_FACTOR 0.98
+#define PERFECT_MAX_ATTEMPTS 16
+
+typedef struct
+{
+    void *key;
+    size_t key_size;
+    void *value;
+} perfect_table_slot;
+
+typedef struct
+{
+    size_t entries;
+    size_t positions;
+    size_t bucket_count;
+    uint16_t *pilots;
+    // The slot of every position from entries up, or UINT32_MAX if no key has the position
+    uint32_t *remap;
+    perfect_table_slot *slots;
+
+    perfect_table_slot *staged;
+    size_t staged_length;
+    size_t staged_capacity;
+
+    bool built;
+    size_t attempts;
+    double build_ms;
+    lookup_stats lookup_stats;
+    uint64_t seed;
+} perfect_table;
+
+/**
+ * Creates an empty perfect table. Only the hash function and seed of the options are used.
+ */
+perfect_table *perfect_table_create(const hash_table_options *options)
+{
+    perfect_table *table = (perfect_table *)calloc(1, sizeof(perfect_table));
+    hash_table_options defaults = hash_table_default_options();
+    options = options != NULL ? options : &defaults;
+    table->seed = options->seed;
+    return table;
+}
+
+void perfect_table_free(perfect_table *table)
+{
+    free(table->pilots);
+    free(table->remap);
+    free(table->slots);
+    free(table->staged);
+    free(table);
+}
+
+/**
+ * Stages a key for the index. Keys added after the index is built are ignored.
+ */
+void perfect_table_add(perfect_table *table, void *key, size_t key_size, void *value)
+{
+    if (table->built)
+    {
+        return;
+    }
+    if (table->staged_length == table->staged_capacity)
+    {
+        table->staged_capacity = table->staged_capacity ? table->staged_capacity * 2 : 1024;
+        table->staged = realloc(table->staged, table->staged_capacity * sizeof(perfect_table_slot));
+    }
+    table->staged[table->staged_length++] = (perfect_table_slot){key, key_size, value};
+}
+
+/**
+ * Hashes the key with the table's seed. Two different keys with the same hash can never be separated
+ * by a pilot, so the index always uses the full 64 bits of wyhash, whatever hash function is selected.
+ */
+uint64_t perfect_table_hash(const perfect_table *table, const void *key, size_t key_size)
+{
+    return hash_wyhash(key, key_size, table->seed);
+}
+
+size_t perfect_table_bucket(const perfect_table *table, uint64_t hash)
+{
+    return (hash >> 32) % table->bucket_count;
+}
+
+/**
+ * Gets the position of a hash with the pilot, before it is remapped.
+ */
+size_t perfect_table_pilot_position(const perfect_table *table, uint64_t hash, uint16_t pilot)
+{
+    return (hash ^ typed_mix64(pilot + 0x9e3779b97f4a7c15ull)) % table->positions;
+}
+
+/**
+ * Gets the slot the hash would be in.
+ */
+size_t perfect_table_slot_of(const perfect_table *table, uint64_t hash)
+{
+    size_t position = perfect_table_pilot_position(table, hash, table->pilots[perfect_table_bucket(table, hash)]);
+    return position < table->entries ? position : table->remap[position - table->entries];
+}
+
+/**
+ * Sorts the staged keys into their buckets. After it, the keys of bucket b are order[starts[b]] to order[starts[b + 1] - 1],
+ * in the order they were staged.
+ */
+void perfect_table_group(const perfect_table *table, const uint64_t *hashes, size_t n, size_t *starts, size_t *order)
+{
+    memset(starts, 0, (table->bucket_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+    {
+        starts[perfect_table_bucket(table, hashes[i]) + 1]++;
+    }
+    for (size_t b = 0; b < table->bucket_count; b++)
+    {
+        starts[b + 1] += starts[b];
+    }
+    size_t *next = malloc(table->bucket_count * sizeof(size_t));
+    memcpy(next, starts, table->bucket_count * sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+    {
+        order[next[perfect_table_bucket(table, hashes[i])]++] = i;
+    }
+    free(next);
+}
+
+/**
+ * Tries to build the index with the current seed. Returns false if two different keys have the same hash,
+ * or a bucket finds no pilot, so the build has to be retried with another seed.
+ */
+bool perfect_table_try_build(perfect_table *table)
+{
+    size_t n = table->staged_length;
+    uint64_t *hashes = malloc(n * sizeof(uint64_t) + 1);
+    size_t *starts = malloc((table->bucket_count + 1) * sizeof(size_t));
+    size_t *order = malloc(n * sizeof(size_t) + 1);
+    bool ok = true;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        hashes[i] = perfect_table_hash(table, table->staged[i].key, table->staged[i].key_size);
+    }
+    perfect_table_group(table, hashes, n, starts, order);
+
+    // A repeated key is dropped in favour of its last copy. Copies are always in the same bucket.
+    bool *dropped = calloc(n + 1, sizeof(bool));
+    size_t max_bucket_size = 0;
+    for (size_t b = 0; b < table->bucket_count; b++)
+    {
+        size_t size = starts[b + 1] - starts[b];
+        max_bucket_size = size > max_bucket_size ? size : max_bucket_size;
+    }
+    for (size_t b = 0; ok && b < table->bucket_count; b++)
+    {
+        for (size_t i = starts[b]; ok && i < starts[b + 1]; i++)
+        {
+            for (size_t j = i + 1; ok && j < starts[b + 1]; j++)
+            {
+                const perfect_table_slot *a = &table->staged[order[i]];
+                const perfect_table_slot *c = &table->staged[order[j]];
+                if (hashes[order[i]] != hashes[order[j]])
+                {
+                    continue;
+                }
+                if (a->key_size == c->key_size && memcmp(a->key, c->key, a->key_size) == 0)
+                {
+                    dropped[order[i]] = true;
+                }
+                else
+                {
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    // Place the largest buckets first, while most positions are free.
+    size_t *by_size = calloc(max_bucket_size + 2, sizeof(size_t));
+    size_t *buckets = malloc(table->bucket_count * sizeof(size_t));
+    for (size_t b = 0; b < table->bucket_count; b++)
+    {
+        by_size[max_bucket_size - (starts[b + 1] - starts[b]) + 1]++;
+    }
+    for (size_t size = 0; size <= max_bucket_size; size++)
+    {
+        by_size[size + 1] += by_size[size];
+    }
+    for (size_t b = 0; b < table->bucket_count; b++)
+    {
+        buckets[by_size[max_bucket_size - (starts[b + 1] - starts[b])]++] = b;
+    }
+
+    uint8_t *taken = calloc(table->positions / 8 + 1, 1);
+    size_t *positions = malloc((max_bucket_size + 1) * sizeof(size_t));
+    for (size_t k = 0; ok && k < table->bucket_count; k++)
+    {
+        size_t b = buckets[k];
+        uint32_t pilot = 0;
+        for (; pilot <= UINT16_MAX; pilot++)
+        {
+            size_t placed = 0;
+            bool fits = true;
+            for (size_t i = starts[b]; fits && i < starts[b + 1]; i++)
+            {
+                if (dropped[order[i]])
+                {
+                    continue;
+                }
+                size_t position = perfect_table_pilot_position(table, hashes[order[i]], pilot);
+                fits = !(taken[position / 8] & (1 << (position % 8)));
+                for (size_t p = 0; fits && p < placed; p++)
+                {
+                    fits = positions[p] != position;
+                }
+                positions[placed++] = position;
+            }
+            if (fits)
+            {
+                for (size_t p = 0; p < placed; p++)
+                {
+                    taken[positions[p] / 8] |= 1 << (positions[p] % 8);
+                }
+                break;
+            }
+        }
+        table->pilots[b] = pilot;
+        ok = pilot <= UINT16_MAX;
+    }
+
+    if (ok)
+    {
+        // Give the keys past the end the free positions before it.
+        table->entries = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            table->entries += !dropped[i];
+        }
+        // Sized once the repeated keys are dropped, as it is indexed from the number of kept keys
+        table->remap = calloc(table->positions - table->entries + 1, sizeof(uint32_t));
+        size_t free_position = 0;
+        for (size_t position = table->entries; position < table->positions; position++)
+        {
+            table->remap[position - table->entries] = UINT32_MAX;
+            if (taken[position / 8] & (1 << (position % 8)))
+            {
+                while (taken[free_position / 8] & (1 << (free_position % 8)))
+                {
+                    free_position++;
+                }
+                table->remap[position - table->entries] = free_position++;
+            }
+        }
+        table->slots = malloc(table->entries * sizeof(perfect_table_slot) + 1);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (!dropped[i])
+            {
+                table->slots[perfect_table_slot_of(table, hashes[i])] = table->staged[i];
+            }
+        }
+    }
+
+    free(positions);
+    free(taken);
+    free(buckets);
+    free(by_size);
+    free(dropped);
+    free(order);
+    free(starts);
+    free(hashes);
+    return ok;
+}
+
+/**
+ * Builds the index over the staged keys. If a seed fails, the build is retried with up to
+ * PERFECT_MAX_ATTEMPTS seeds. Returns false if no seed worked, and the table stays empty.
+ */
+bool perfect_table_build(perfect_table *table)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t n = table->staged_length;
+    table->bucket_count = n / PERFECT_BUCKET_SIZE + 1;
+    table->positions = (size_t)(n / PERFECT_LOAD_FACTOR) + 1;
+    table->pilots = calloc(table->bucket_count, sizeof(uint16_t));
+    uint64_t seed = table->seed;
+    for (table->attempts = 1; table->attempts <= PERFECT_MAX_ATTEMPTS; table->attempts++)
+    {
+        if (perfect_table_try_build(table))
+        {
+            table->built = true;
+            break;
+        }
+        table->seed = typed_mix64(seed + table->attempts);
+    }
+    free(table->staged);
+    table->staged = NULL;
+    table->staged_length = table->staged_capacity = 0;
+    if (!table->built)
+    {
+        table->attempts = PERFECT_MAX_ATTEMPTS;
+        table->entries = 0;
+        fprintf(stderr, "Could not build a perfect hash in %d attempts, too many keys have the same hash.\n", PERFECT_MAX_ATTEMPTS);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    table->build_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+    return table->built;
+}
+
+/**
+ * Performs lookup in the perfect table based on the key and writes the value to the value pointer.
+ * If the function does not find a match, it returns false and the value pointer is not written to.
+ */
+bool perfect_table_lookup(perfect_table *table, const void *key, size_t key_size, void **value)
+{
+    bool found = false;
+    if (table->built && table->entries > 0)
+    {
+        // A key that is not in the table can land on a position past the end that no key has
+        size_t index = perfect_table_slot_of(table, perfect_table_hash(table, key, key_size));
+        const perfect_table_slot *slot = index < table->entries ? &table->slots[index] : NULL;
+        found = slot != NULL && slot->key_size == key_size && memcmp(slot->key, key, key_size) == 0;
+        if (found)
+        {
+            *value = slot->value;
+        }
+    }
+    lookup_stats_record(&table->lookup_stats, found, 0);
+    return found;
+}
+
+/**
+ * Gets the size of the perfect hash function in bits per key: the pilots and the remapped positions,
+ * without the slots.
+ */
+double perfect_table_bits_per_key(perfect_table *table)
+{
+    size_t bits = table->bucket_count * 16 + (table->positions - table->entries) * 32;
+    return table->entries ? (double)bits / table->entries : 0;
+}
+
+/***************************************
+ * Table backends                      *
+ ***************************************/
+
+/**
+ * The typed backend is a typed_table.h table specialized for string keys at compile time,
+ * so it always hashes with wyhash, whatever hash function is selected.
+ */
+uint64_t typed_string_hash(typed_string key, uint64_t seed)
+{
+    return hash_wyhash(key.data, key.size, seed);
+}
+
+TYPED_TABLE_DEFINE(string_table, typed_string, void *, typed_string_hash, typed_string_equal)
+
+/**
+ * table_backend selects the implementation behind a name_table.
+ */
+typedef enum
+{
+    BACKEND_CHAINED,
+    BACKEND_SWISS,
+    BACKEND_TYPED,
+    // Staged keys indexed by a minimal perfect hash once name_table_build is called
+    BACKEND_PERFECT,
+    // A sharded_table, safe for concurrent adds and lookups
+    BACKEND_SHARDED,
+    // A read-only hash_table_snapshot, created with name_table_from_snapshot
+    BACKEND_SNAPSHOT,
+} table_backend;
+
+const char *const table_backend_names[] = {"chained", "swiss", "typed", "perfect", "sharded", "snapshot"};
+
+/**
+ * name_table is a string-keyed table that forwards to the selected backend.
+ * The typed backend keeps no lookup statistics of its own, so they are kept here.
+ */
+typedef struct
+{
+    table_backend backend;
+    union
+    {
+        hash_table *chained;
+        swiss_table *swiss;
+        string_table *typed;
+        perfect_table *perfect;
+        sharded_table *sharded;
+        hash_table_snapshot *snapshot;
+    };
+    lookup_stats typed_stats;
+} name_table;
+
+name_table name_table_create(table_backend backend, size_t capacity, const hash_table_options *options)
+{
+    name_table table = {.backend = backend};
+    switch (backend)
+    {
+    case BACKEND_CHAINED:
+        table.chained = hash_table_create(capacity, options);
+        break;
+    case BACKEND_SWISS:
+        table.swiss = swiss_table_create(capacity, options);
+        break;
+    case BACKEND_TYPED:
+        // Sized like the swiss table, to fit the capacity without growing
+        table.typed = string_table_create(capacity / 7 * 8 + 8, options != NULL ? options->seed : 0);
+        break;
+    case BACKEND_PERFECT:
+        table.perfect = perfect_table_create(options);
+        break;
+    case BACKEND_SHARDED:
+        table.sharded = sharded_table_create(capacity, options);
+        break;
+    case BACKEND_SNAPSHOT:
+        break;
+    }
+    return table;
+}
+
+/**
+ * Wraps a mapped snapshot in a name_table, which takes ownership of it.
+ * Adding to the name_table does nothing.
+ */
+name_table name_table_from_snapshot(hash_table_snapshot *snapshot)
+{
+    return (name_table){.backend = BACKEND_SNAPSHOT, .snapshot = snapshot};
+}
+
+void name_table_free(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        hash_table_free(table->chained);
+        break;
+    case BACKEND_SWISS:
+        swiss_table_free(table->swiss);
+        break;
+    case BACKEND_TYPED:
+        string_table_free(table->typed);
+        break;
+    case BACKEND_PERFECT:
+        perfect_table_free(table->perfect);
+        break;
+    case BACKEND_SHARDED:
+        sharded_table_free(table->sharded);
+        break;
+    case BACKEND_SNAPSHOT:
+        hash_table_snapshot_close(table->snapshot);
+        break;
+    }
+}
+
+void name_table_add(name_table *table, void *key, size_t key_size, void *value)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        hash_table_add(table->chained, key, key_size, value);
+        break;
+    case BACKEND_SWISS:
+        swiss_table_add(table->swiss, key, key_size, value);
+        break;
+    case BACKEND_TYPED:
+        string_table_add(table->typed, (typed_string){key, key_size}, value);
+        break;
+    case BACKEND_PERFECT:
+        perfect_table_add(table->perfect, key, key_size, value);
+        break;
+    case BACKEND_SHARDED:
+        sharded_table_add(table->sharded, key, key_size, value);
+        break;
+    case BACKEND_SNAPSHOT:
+        break;
+    }
+}
+
+/**
+ * Called once every key has been added. Builds the index of the backends that need every key first,
+ * and does nothing for the others.
+ */
+void name_table_build(name_table *table)
+{
+    if (table->backend == BACKEND_PERFECT)
+    {
+        perfect_table_build(table->perfect);
+    }
+}
+
+/**
+ * Looks up the key in the typed backend, recording the probe length as the depth.
+ */
+bool name_table_lookup_typed(name_table *table, const void *key, size_t key_size, void **value)
+{
+    typed_string string = {key, key_size};
+    size_t slot, depth;
+    bool found = string_table_find(table->typed, string, typed_string_hash(string, table->typed->seed), &slot, &depth);
+    lookup_stats_record(&table->typed_stats, found, depth);
+    if (found && value != NULL)
+    {
+        *value = table->typed->slots[slot].value;
+    }
+    return found;
+}
+
+bool name_table_lookup(name_table *table, void *key, size_t key_size, void **value)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_lookup(table->chained, key, key_size, value);
+    case BACKEND_SWISS:
+        return swiss_table_lookup(table->swiss, key, key_size, value);
+    case BACKEND_TYPED:
+        return name_table_lookup_typed(table, key, key_size, value);
+    case BACKEND_PERFECT:
+        return perfect_table_lookup(table->perfect, key, key_size, value);
+    case BACKEND_SHARDED:
+        return sharded_table_lookup(table->sharded, key, key_size, value);
+    case BACKEND_SNAPSHOT:
+        return hash_table_snapshot_lookup(table->snapshot, key, key_size, value);
+    }
+    return false;
+}
+
+void name_table_lookup_batch(name_table *table, void *const keys[], const size_t sizes[], size_t n, void *values_out[], bool found_out[])
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        hash_table_lookup_batch(table->chained, keys, sizes, n, values_out, found_out);
+        break;
+    case BACKEND_SWISS:
+        swiss_table_lookup_batch(table->swiss, keys, sizes, n, values_out, found_out);
+        break;
+    case BACKEND_TYPED:
+        for (size_t i = 0; i < n; i++)
+        {
+            found_out[i] = name_table_lookup_typed(table, keys[i], sizes[i], &values_out[i]);
+        }
+        break;
+    case BACKEND_PERFECT:
+        for (size_t i = 0; i < n; i++)
+        {
+            found_out[i] = perfect_table_lookup(table->perfect, keys[i], sizes[i], &values_out[i]);
+        }
+        break;
+    case BACKEND_SHARDED:
+        sharded_table_lookup_batch(table->sharded, keys, sizes, n, values_out, found_out);
+        break;
+    case BACKEND_SNAPSHOT:
+        for (size_t i = 0; i < n; i++)
+        {
+            found_out[i] = hash_table_snapshot_lookup(table->snapshot, keys[i], sizes[i], &values_out[i]);
+        }
+        break;
+    }
+}
+
+size_t name_table_entries(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_entries(table->chained);
+    case BACKEND_SWISS:
+        return swiss_table_entries(table->swiss);
+    case BACKEND_PERFECT:
+        return table->perfect->entries;
+    case BACKEND_SHARDED:
+        return sharded_table_entries(table->sharded);
+    case BACKEND_SNAPSHOT:
+        return table->snapshot->header->entries;
+    default:
+        return string_table_entries(table->typed);
+    }
+}
+
+float name_table_load_factor(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_load_factor(table->chained);
+    case BACKEND_SWISS:
+        return swiss_table_load_factor(table->swiss);
+    case BACKEND_PERFECT:
+        return table->perfect->positions ? (float)table->perfect->entries / (float)table->perfect->positions : 0;
+    case BACKEND_SHARDED:
+        return sharded_table_load_factor(table->sharded);
+    case BACKEND_SNAPSHOT:
+        return (float)table->snapshot->header->entries / (float)table->snapshot->header->capacity;
+    default:
+        return string_table_load_factor(table->typed);
+    }
+}
+
+size_t name_table_collisions(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_collisions(table->chained);
+    case BACKEND_SWISS:
+        return swiss_table_collisions(table->swiss);
+    case BACKEND_PERFECT:
+        return 0;
+    case BACKEND_SHARDED:
+        return sharded_table_collisions(table->sharded);
+    case BACKEND_SNAPSHOT:
+        return table->snapshot->header->collisions;
+    default:
+        return string_table_collisions(table->typed);
+    }
+}
+
+size_t name_table_capacity(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_capacity(table->chained);
+    case BACKEND_SWISS:
+        return swiss_table_capacity(table->swiss);
+    case BACKEND_PERFECT:
+        return table->perfect->positions;
+    case BACKEND_SHARDED:
+        return sharded_table_capacity(table->sharded);
+    case BACKEND_SNAPSHOT:
+        return table->snapshot->header->capacity;
+    default:
+        return string_table_capacity(table->typed);
+    }
+}
+
+size_t name_table_rehashes(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_rehashes(table->chained);
+    case BACKEND_SWISS:
+        return swiss_table_rehashes(table->swiss);
+    case BACKEND_PERFECT:
+        return table->perfect->attempts > 0 ? table->perfect->attempts - 1 : 0;
+    case BACKEND_SHARDED:
+        return sharded_table_rehashes(table->sharded);
+    case BACKEND_SNAPSHOT:
+        return 0;
+    default:
+        return string_table_growths(table->typed);
+    }
+}
+
+const lookup_stats *name_table_lookup_stats(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return hash_table_lookup_stats(table->chained);
+    case BACKEND_SWISS:
+        return swiss_table_lookup_stats(table->swiss);
+    case BACKEND_PERFECT:
+        return &table->perfect->lookup_stats;
+    case BACKEND_SHARDED:
+        return sharded_table_lookup_stats(table->sharded);
+    case BACKEND_SNAPSHOT:
+        return &table->snapshot->lookup_stats;
+    default:
+        return &table->typed_stats;
+    }
+}
+
+/**
+ * Gets the page size the table memory actually got, which can be smaller than requested.
+ */
+page_mode name_table_pages(name_table *table)
+{
+    switch (table->backend)
+    {
+    case BACKEND_CHAINED:
+        return large_pages(table->chained->buckets);
+    case BACKEND_SWISS:
+        return large_pages(table->swiss->slots);
+    case BACKEND_SHARDED:
+        return large_pages(table->sharded->shards[0].table->buckets);
+    default:
+        // The typed and perfect backends use malloc, and a snapshot is mapped from its file
+        return PAGES_DEFAULT;
+    }
+}
+
+/***************************************
+ * Line scanning                       *
+ ***************************************/
+
+/**
+ * newline_scanner finds the positions of up to 'max' newlines in buf, starting at *offset.
+ * Returns the number of positions written and advances *offset past the scanned bytes.
+ */
+typedef size_t newline_scanner(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max);
+
+/**
+ * Scans for newlines using memchr, which is vectorized by most C libraries.
+ */
+size_t scan_newlines_memchr(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    size_t i = *offset;
+    size_t count = 0;
+    while (count < max && i < size)
+    {
+        const char *newline = memchr(buf + i, '\n', size - i);
+        if (newline == NULL)
+        {
+            i = size;
+            break;
+        }
+        positions[count++] = newline - buf;
+        i = newline - buf + 1;
+    }
+    *offset = i;
+    return count;
+}
+
+/**
+ * Scans the remaining bytes of the buffer one at a time.
+ */
+size_t scan_newlines_tail(const char *buf, size_t size, size_t *offset, size_t *positions, size_t count, size_t max)
+{
+    size_t i = *offset;
+    for (; i < size && count < max; i++)
+    {
+        if (buf[i] == '\n')
+        {
+            positions[count++] = i;
+        }
+    }
+    *offset = i;
+    return count;
+}
+
+/**
+ * Writes the positions of the bits set in the block mask.
+ * If there is not enough room for all of them, *offset is moved to just past the last position written
+ * and false is returned, so the rest of the block is scanned again on the next call.
+ */
+bool emit_newline_mask(uint64_t mask, size_t block_offset, size_t bits_per_byte, size_t *offset, size_t *positions, size_t *count, size_t max)
+{
+    while (mask != 0)
+    {
+        if (*count == max)
+        {
+            *offset = positions[*count - 1] + 1;
+            return false;
+        }
+        positions[(*count)++] = block_offset + __builtin_ctzll(mask) / bits_per_byte;
+        // Clear every bit belonging to the byte that was found.
+        mask &= ~(((1ull << bits_per_byte) - 1) << (__builtin_ctzll(mask) / bits_per_byte * bits_per_byte));
+    }
+    return true;
+}
+
+#if defined(__x86_64__)
+bool cpu_has_sse2()
+{
+    return true;
+}
+
+bool cpu_has_avx2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+/**
+ * Scans for newlines 16 bytes at a time using SSE2 compares.
+ */
+size_t scan_newlines_sse2(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = *offset;
+    size_t count = 0;
+    for (; i + 16 <= size && count < max; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+        uint64_t mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (!emit_newline_mask(mask, i, 1, offset, positions, &count, max))
+        {
+            return count;
+        }
+    }
+    *offset = i;
+    return scan_newlines_tail(buf, size, offset, positions, count, max);
+}
+
+/**
+ * Scans for newlines 32 bytes at a time using AVX2 compares.
+ */
+__attribute__((target("avx2"))) size_t scan_newlines_avx2(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = *offset;
+    size_t count = 0;
+    for (; i + 32 <= size && count < max; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+        uint64_t mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        if (!emit_newline_mask(mask, i, 1, offset, positions, &count, max))
+        {
+            return count;
+        }
+    }
+    *offset = i;
+    return scan_newlines_tail(buf, size, offset, positions, count, max);
+}
+#else
+bool cpu_has_sse2()
+{
+    return false;
+}
+
+bool cpu_has_avx2()
+{
+    return false;
+}
+
+size_t scan_newlines_sse2(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    return scan_newlines_memchr(buf, size, offset, positions, max);
+}
+
+size_t scan_newlines_avx2(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    return scan_newlines_memchr(buf, size, offset, positions, max);
+}
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+
+bool cpu_has_neon()
+{
+    return true;
+}
+
+/**
+ * Scans for newlines 16 bytes at a time using NEON compares.
+ * NEON has no movemask, so the compare result is narrowed to 4 bits per byte instead.
+ */
+size_t scan_newlines_neon(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    size_t i = *offset;
+    size_t count = 0;
+    for (; i + 16 <= size && count < max; i += 16)
+    {
+        uint8x16_t matches = vceqq_u8(vld1q_u8((const uint8_t *)(buf + i)), newline);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+        if (!emit_newline_mask(mask, i, 4, offset, positions, &count, max))
+        {
+            return count;
+        }
+    }
+    *offset = i;
+    return scan_newlines_tail(buf, size, offset, positions, count, max);
+}
+#else
+bool cpu_has_neon()
+{
+    return false;
+}
+
+size_t scan_newlines_neon(const char *buf, size_t size, size_t *offset, size_t *positions, size_t max)
+{
+    return scan_newlines_memchr(buf, size, offset, positions, max);
+}
+#endif
+
+/**
+ * newline_scanner_algorithm describes a selectable newline scanner.
+ */
+typedef struct
+{
+    const char *name;
+    newline_scanner *func;
+    bool (*available)();
+} newline_scanner_algorithm;
+
+const newline_scanner_algorithm newline_scanners[] = {
+    {"avx2", &scan_newlines_avx2, &cpu_has_avx2},
+    {"sse2", &scan_newlines_sse2, &cpu_has_sse2},
+    {"neon", &scan_newlines_neon, &cpu_has_neon},
+    {"memchr", &scan_newlines_memchr, &cpu_has_baseline},
+};
+const int newline_scanners_length = sizeof(newline_scanners) / sizeof(newline_scanners[0]);
+
+/**
+ * Finds an available newline scanner by name. "auto" selects the widest one the CPU supports.
+ * Returns NULL if the scanner does not exist or is not supported by the CPU.
+ */
+const newline_scanner_algorithm *newline_scanner_find(const char *name)
+{
+    for (int i = 0; i < newline_scanners_length; i++)
+    {
+        bool matches = strcmp(name, "auto") == 0 || strcmp(newline_scanners[i].name, name) == 0;
+        if (matches && newline_scanners[i].available())
+        {
+            return &newline_scanners[i];
+        }
+    }
+    return NULL;
+}
+
+#define LINE_BATCH_SIZE 64
+
+/**
+ * line_reader splits a buffer into lines, scanning for the newlines in batches.
+ * Lines may end in either LF or CRLF. If 'final' is set, trailing text without a newline forms the last line.
+ */
+typedef struct
+{
+    const char *buf;
+    size_t size;
+    bool final;
+    newline_scanner *scan;
+
+    // Position the scanner continues from, and where the next line starts.
+    size_t offset;
+    size_t start;
+
+    size_t positions[LINE_BATCH_SIZE];
+    size_t count;
+    size_t next;
+} line_reader;
+
+void line_reader_init(line_reader *reader, const char *buf, size_t size, bool final, newline_scanner *scan)
+{
+    *reader = (line_reader){
+        .buf = buf,
+        .size = size,
+        .final = final,
+        .scan = scan,
+    };
+}
+
+/**
+ * Gets the next line without its line ending.
+ * Returns false when there are no more lines.
+ */
+bool line_reader_next(line_reader *reader, const char **line, size_t *length)
+{
+    size_t end;
+    if (reader->next == reader->count)
+    {
+        reader->count = 0;
+        reader->next = 0;
+        while (reader->count == 0 && reader->offset < reader->size)
+        {
+            reader->count = reader->scan(reader->buf, reader->size, &reader->offset, reader->positions, LINE_BATCH_SIZE);
+        }
+    }
+
+    if (reader->next < reader->count)
+    {
+        end = reader->positions[reader->next++];
+    }
+    else if (reader->final && reader->start < reader->size)
+    {
+        end = reader->size;
+    }
+    else
+    {
+        return false;
+    }
+
+    *line = reader->buf + reader->start;
+    *length = end - reader->start;
+    if (*length > 0 && (*line)[*length - 1] == '\r')
+    {
+        (*length)--;
+    }
+    reader->start = end < reader->size ? end + 1 : end;
+    return true;
+}
+
+/**
+ * Gets the number of bytes consumed by the lines read so far.
+ */
+size_t line_reader_consumed(line_reader *reader)
+{
+    return reader->start;
+}
+
+/***************************************
+ * Program code                        *
+ ***************************************/
+const char MAIKEN_NAME[] = "Maiken Louise Brechan";
+const char MARTIN_NAME[] = "Martin Dolmen Helmersen";
+const char MAGNUS_NAME[] = "Magnus Hektoen Steensland";
+const char NORBERT_NAME[] = "Norbert Arkadiusz Görke";
+const char EULER_NAME[] = "Leonhard Euler";
+const int HASH_TABLE_CAPACITY = 127;
+const size_t STREAM_CHUNK_SIZE = 1024 * 1024;
+const size_t TRACE_RING_CAPACITY = 64 * 1024;
+
+/**
+ * input_mode determines how the names file is brought into memory.
+ * 
+ * INPUT_MMAP maps the file and stores keys pointing straight into the mapping.
+ * INPUT_READ reads the whole file into a single buffer.
+ * INPUT_STREAM reads the input in chunks, which also works for pipes and stdin.
+ * INPUT_AUTO uses mmap for regular files and streaming for everything else.
+ */
+typedef enum
+{
+    INPUT_AUTO,
+    INPUT_MMAP,
+    INPUT_READ,
+    INPUT_STREAM,
+} input_mode;
+
+/**
+ * Options for the program, set from the command line.
+ */
+typedef struct
+{
+    const char *file_path;
+    input_mode input;
+    table_backend backend;
+    const char *hash_name;
+    bool compare_hashes;
+    const char *allocator_name;
+    hash_table_allocator heap_allocator;
+    const newline_scanner_algorithm *scanner;
+    bool trace;
+    const char *join_path;
+    // Where to save the built table, and a saved table to use instead of building one (NULL for none)
+    const char *save_path;
+    const char *snapshot_path;
+    // Threads building the table from a whole buffer (chained backend only)
+    int threads;
+    hash_table_options table_options;
+} program_options;
+
+/**
+ * Performs a person ID lookup in the hash table.
+ * Returns -1 if a person with the specified name is not found.
+ */
+int person_lookup(name_table *table, const char *name, size_t name_size)
+{
+    void *id;
+    if (!name_table_lookup(table, (void *)name, name_size, &id))
+    {
+        return -1;
+    }
+    return (int)(uintptr_t)id;
+}
+
+/**
+ * Gets the elapsed time between start and end in milliseconds.
+ */
+double elapsed_ms(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+/**
+ * Adds every name in the buffer to the table, one per line, using the line number as the person ID.
+ * The person ID continues from *person_id, which is updated.
+ * Unless 'final' is set, text after the last newline is left for the next call. The final call also builds the table.
+ * Returns the number of bytes consumed.
+ */
+size_t fill_table_from(name_table *table, const char *names, size_t size, bool final, int *person_id, const program_options *options)
+{
+    line_reader reader;
+    const char *name;
+    size_t name_size;
+    line_reader_init(&reader, names, size, final, options->scanner->func);
+    while (line_reader_next(&reader, &name, &name_size))
+    {
+        name_table_add(table, (void *)name, name_size, (void *)(uintptr_t)(*person_id)++);
+    }
+    if (final)
+    {
+        name_table_build(table);
+    }
+    return line_reader_consumed(&reader);
+}
+
+/**
+ * A part of the buffer split into lines by one thread.
+ */
+typedef struct
+{
+    const char *names;
+    size_t size;
+    newline_scanner *scan;
+    void **keys;
+    size_t *sizes;
+    size_t length;
+} line_split_job;
+
+void *line_split_run(void *arg)
+{
+    line_split_job *job = (line_split_job *)arg;
+    size_t capacity = 1024;
+    job->keys = malloc(capacity * sizeof(void *));
+    job->sizes = malloc(capacity * sizeof(size_t));
+
+    line_reader reader;
+    const char *name;
+    size_t name_size;
+    line_reader_init(&reader, job->names, job->size, true, job->scan);
+    while (line_reader_next(&reader, &name, &name_size))
+    {
+        if (job->length == capacity)
+        {
+            capacity *= 2;
+            job->keys = realloc(job->keys, capacity * sizeof(void *));
+            job->sizes = realloc(job->sizes, capacity * sizeof(size_t));
+        }
+        job->keys[job->length] = (void *)name;
+        job->sizes[job->length] = name_size;
+        job->length++;
+    }
+    return NULL;
+}
+
+/**
+ * Adds every name in the buffer to the chained table on options->threads threads.
+ * The buffer is split on line boundaries, every part is split into lines on its own thread,
+ * and the names are added with hash_table_add_parallel. The person IDs are still the line numbers.
+ */
+void fill_table_parallel(name_table *table, const char *names, size_t size, const program_options *options)
+{
+    int threads = options->threads;
+    line_split_job *jobs = calloc(threads, sizeof(line_split_job));
+    size_t start = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        // Every part ends after the first newline past its share of the buffer
+        size_t end = t + 1 == threads ? size : (t + 1) * (size / threads);
+        end = end < start ? start : end;
+        const char *newline = end < size ? memchr(names + end, '\n', size - end) : NULL;
+        end = newline != NULL ? (size_t)(newline - names) + 1 : size;
+        jobs[t] = (line_split_job){.names = names + start, .size = end - start, .scan = options->scanner->func};
+        start = end;
+    }
+    run_threads(threads, &line_split_run, jobs, sizeof(line_split_job));
+
+    size_t n = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        n += jobs[t].length;
+    }
+    void **keys = malloc(n * sizeof(void *) + 1);
+    size_t *sizes = malloc(n * sizeof(size_t) + 1);
+    void **values = malloc(n * sizeof(void *) + 1);
+    size_t offset = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        memcpy(keys + offset, jobs[t].keys, jobs[t].length * sizeof(void *));
+        memcpy(sizes + offset, jobs[t].sizes, jobs[t].length * sizeof(size_t));
+        offset += jobs[t].length;
+        free(jobs[t].keys);
+        free(jobs[t].sizes);
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        values[i] = (void *)(uintptr_t)i;
+    }
+
+    hash_table_add_parallel(table->chained, keys, sizes, values, n, threads);
+
+    free(keys);
+    free(sizes);
+    free(values);
+    free(jobs);
+}
+
+/**
+ * Adds every name in the buffer to the table, one per line, using the line number as the person ID.
+ */
+void fill_table(name_table *table, const char *names, size_t size, const program_options *options)
+{
+    if (options->threads > 1 && table->backend == BACKEND_CHAINED)
+    {
+        fill_table_parallel(table, names, size, options);
+        return;
+    }
+    int person_id = 0;
+    fill_table_from(table, names, size, true, &person_id, options);
+}
+
+/**
+ * Looks up every name in the buffer and returns the number of names that were found.
+ */
+size_t lookup_all(name_table *table, const char *names, size_t size, const program_options *options)
+{
+    line_reader reader;
+    const char *name;
+    size_t name_size;
+    size_t found = 0;
+    line_reader_init(&reader, names, size, true, options->scanner->func);
+    while (line_reader_next(&reader, &name, &name_size))
+    {
+        found += person_lookup(table, name, name_size) != -1;
+    }
+    return found;
+}
+
+/**
+ * Builds a table from the buffer with every available hash function and prints the collisions and timings.
+ */
+void compare_hashes(const char *names, size_t size, const program_options *options)
+{
+    const int column_size = 11;
+    hash_table_options table_options = options->table_options;
+    table_options.trace = NULL;
+
+    printf(
+        "%*s | %*s | %*s | %*s | %*s\n",
+        column_size, "Hash",
+        column_size, "Capacity",
+        column_size, "Collisions",
+        column_size, "Fill (ms)",
+        column_size, "Lookup (ms)");
+    for (int i = 0; i < hash_algorithms_length; i++)
+    {
+        if (!hash_algorithms[i].available())
+        {
+            printf("%*s | %*s\n", column_size, hash_algorithms[i].name, column_size, "unsupported");
+            continue;
+        }
+
+        struct timespec start, filled, end;
+        table_options.hash = hash_algorithms[i].func;
+        name_table table = name_table_create(options->backend, HASH_TABLE_CAPACITY, &table_options);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        fill_table(&table, names, size, options);
+        clock_gettime(CLOCK_MONOTONIC, &filled);
+        lookup_all(&table, names, size, options);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        printf("%*s | %*lu | %*lu | %*.3f | %*.3f\n",
+               column_size, hash_algorithms[i].name,
+               column_size, name_table_capacity(&table),
+               column_size, name_table_collisions(&table),
+               column_size, elapsed_ms(start, filled),
+               column_size, elapsed_ms(filled, end));
+        name_table_free(&table);
+    }
+}
+
+/**
+ * Prints what the Bloom filter of the chained backend has answered so far, if it has one.
+ */
+void print_bloom_stats(name_table *table)
+{
+    hash_table *filtered;
+    size_t blocks, rejects, false_positives;
+    if (table->backend == BACKEND_CHAINED)
+    {
+        filtered = table->chained;
+        blocks = filtered->bloom.block_count;
+        rejects = filtered->bloom_rejects;
+        false_positives = filtered->bloom_false_positives;
+    }
+    else if (table->backend == BACKEND_SHARDED)
+    {
+        // Every shard has the same options, so the first one tells how the filters are set up
+        filtered = table->sharded->shards[0].table;
+        blocks = sharded_table_bloom_blocks(table->sharded);
+        sharded_table_bloom_counts(table->sharded, &rejects, &false_positives);
+    }
+    else
+    {
+        return;
+    }
+    if (filtered->bloom.blocks == NULL)
+    {
+        return;
+    }
+    size_t misses = rejects + false_positives;
+    printf("   Bloom filter          : %u bits per key, %u hashes, %ld blocks\n",
+           filtered->options.bloom_bits_per_key, filtered->bloom.hashes, blocks);
+    printf("   Bloom rejected misses : %ld\n", rejects);
+    printf("   Bloom false positives : %ld (%.4f of the misses)\n",
+           false_positives, misses > 0 ? (double)false_positives / (double)misses : 0.0);
+}
+
+/**
+ * Prints the table statistics and the lookups of the well-known persons.
+ */
+void print_report(name_table *table, const program_options *options)
+{
+    size_t entries = name_table_entries(table);
+    float load_factor = name_table_load_factor(table);
+    size_t collisions = name_table_collisions(table);
+    float collisions_per_person = (float)collisions / (float)name_table_entries(table);
+
+    printf("Statistics:\n");
+    printf("   Backend               : %s\n", table_backend_names[options->backend]);
+    if (table->backend == BACKEND_SNAPSHOT)
+    {
+        printf("   Hash function         : %.*s (from the snapshot)\n", (int)sizeof(table->snapshot->header->hash_name), table->snapshot->header->hash_name);
+    }
+    else
+    {
+        const char *hash_name = options->hash_name;
+        if (options->backend == BACKEND_TYPED)
+        {
+            hash_name = "wyhash (fixed by the typed backend)";
+        }
+        else if (options->backend == BACKEND_PERFECT)
+        {
+            hash_name = "wyhash (fixed by the perfect backend)";
+        }
+        printf("   Hash function         : %s\n", hash_name);
+    }
+    printf("   Entry allocator       : %s\n", options->allocator_name);
+    if (table->backend == BACKEND_CHAINED || table->backend == BACKEND_SHARDED)
+    {
+        printf("   Key storage           : %s\n", hash_table_key_storage_names[options->table_options.key_storage]);
+    }
+    printf("   Newline scanner       : %s\n", options->scanner->name);
+    printf("   Table memory          : %s pages, %s NUMA placement\n",
+           page_mode_names[name_table_pages(table)], numa_mode_names[options->table_options.memory.numa]);
+    printf("   Capacity              : %ld\n", name_table_capacity(table));
+    printf("   Rehashes              : %ld\n", name_table_rehashes(table));
+    printf("   Persons registered    : %ld\n", entries);
+    printf("   Collisions            : %ld\n", collisions);
+    printf("   Load factor           : %f\n", load_factor);
+    printf("   Collisions per person : %f\n", collisions_per_person);
+    if (table->backend == BACKEND_SHARDED)
+    {
+        printf("   Shards                : %ld\n", table->sharded->shard_count);
+    }
+    if (table->backend == BACKEND_PERFECT)
+    {
+        printf("   Perfect hash build    : %.3f ms, %ld seeds tried\n", table->perfect->build_ms, table->perfect->attempts);
+        printf("   Perfect hash size     : %.2f bits per key\n", perfect_table_bits_per_key(table->perfect));
+    }
+
+    printf("Lookups:\n");
+    printf("   %s: (ID=%d)\n", MAIKEN_NAME, person_lookup(table, MAIKEN_NAME, sizeof(MAIKEN_NAME) - 1));
+    printf("   %s: (ID=%d)\n", MARTIN_NAME, person_lookup(table, MARTIN_NAME, sizeof(MARTIN_NAME) - 1));
+    printf("   %s: (ID=%d)\n", MAGNUS_NAME, person_lookup(table, MAGNUS_NAME, sizeof(MAGNUS_NAME) - 1));
+    printf("   %s: (ID=%d)\n", NORBERT_NAME, person_lookup(table, NORBERT_NAME, sizeof(NORBERT_NAME) - 1));
+    printf("   %s: (ID=%d)\n", EULER_NAME, person_lookup(table, EULER_NAME, sizeof(EULER_NAME) - 1));
+
+    const lookup_stats *stats = name_table_lookup_stats(table);
+    printf("Lookup depth:\n");
+    printf("   Lookups               : %ld\n", stats->lookups);
+    printf("   Hits                  : %ld\n", stats->hits);
+    for (int i = 0; i < LOOKUP_DEPTH_BUCKETS; i++)
+    {
+        printf("   Depth %d%-14s : %ld\n", i, i == LOOKUP_DEPTH_BUCKETS - 1 ? "+" : "", stats->depth[i]);
+    }
+    print_bloom_stats(table);
+    if (options->table_options.trace != NULL)
+    {
+        printf("   Trace events dropped  : %ld\n", trace_ring_dropped(options->table_options.trace));
+    }
+}
+
+/**
+ * The names looked up by one thread of a concurrent join.
+ */
+typedef struct
+{
+    name_table *table;
+    void *const *keys;
+    const size_t *sizes;
+    void **values;
+    size_t n;
+    size_t found;
+} join_lookup_job;
+
+void *join_lookup_run(void *arg)
+{
+    join_lookup_job *job = (join_lookup_job *)arg;
+    for (size_t i = 0; i < job->n; i++)
+    {
+        job->found += name_table_lookup(job->table, job->keys[i], job->sizes[i], &job->values[i]);
+    }
+    return NULL;
+}
+
+/**
+ * Looks up every name in the join file, once with one lookup per name and once with the batched lookup,
+ * and prints the number of names found and the timings.
+ * The sharded backend also looks up the names split over options->threads threads at once.
+ */
+void run_join(name_table *table, const program_options *options)
+{
+    int fd = open(options->join_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror("Unable to open join file");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    char *names = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (names == MAP_FAILED)
+    {
+        perror("Unable to map join file");
+        return;
+    }
+    madvise(names, size, MADV_SEQUENTIAL);
+
+    // Split the file into names up front, so only the lookups are timed.
+    size_t n = 0;
+    size_t capacity = 1024;
+    void **keys = malloc(capacity * sizeof(void *));
+    size_t *sizes = malloc(capacity * sizeof(size_t));
+    line_reader reader;
+    const char *name;
+    size_t name_size;
+    line_reader_init(&reader, names, size, true, options->scanner->func);
+    while (line_reader_next(&reader, &name, &name_size))
+    {
+        if (n == capacity)
+        {
+            capacity *= 2;
+            keys = realloc(keys, capacity * sizeof(void *));
+            sizes = realloc(sizes, capacity * sizeof(size_t));
+        }
+        keys[n] = (void *)name;
+        sizes[n] = name_size;
+        n++;
+    }
+    void **values = malloc(n * sizeof(void *));
+    bool *found = malloc(n * sizeof(bool));
+
+    struct timespec start, scalar_end, batch_end;
+    size_t scalar_found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < n; i++)
+    {
+        scalar_found += name_table_lookup(table, keys[i], sizes[i], &values[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &scalar_end);
+    name_table_lookup_batch(table, keys, sizes, n, values, found);
+    clock_gettime(CLOCK_MONOTONIC, &batch_end);
+
+    size_t batch_found = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        batch_found += found[i];
+    }
+
+    int threads = table->backend == BACKEND_SHARDED ? options->threads : 1;
+    struct timespec concurrent_start, concurrent_end;
+    size_t concurrent_found = 0;
+    if (threads > 1)
+    {
+        join_lookup_job *jobs = calloc(threads, sizeof(join_lookup_job));
+        for (int t = 0; t < threads; t++)
+        {
+            size_t begin = t * n / threads;
+            jobs[t] = (join_lookup_job){table, keys + begin, sizes + begin, values + begin, (t + 1) * n / threads - begin, 0};
+        }
+        clock_gettime(CLOCK_MONOTONIC, &concurrent_start);
+        run_threads(threads, &join_lookup_run, jobs, sizeof(join_lookup_job));
+        clock_gettime(CLOCK_MONOTONIC, &concurrent_end);
+        for (int t = 0; t < threads; t++)
+        {
+            concurrent_found += jobs[t].found;
+        }
+        free(jobs);
+    }
+
+    printf("Join:\n");
+    printf("   Names looked up       : %ld\n", n);
+    printf("   Found                 : %ld\n", batch_found);
+    printf("   Scalar lookups (ms)   : %.3f\n", elapsed_ms(start, scalar_end));
+    printf("   Batched lookups (ms)  : %.3f\n", elapsed_ms(scalar_end, batch_end));
+    if (threads > 1)
+    {
+        printf("   Concurrent lookups    : %.3f ms on %d threads\n", elapsed_ms(concurrent_start, concurrent_end), threads);
+    }
+    print_bloom_stats(table);
+    if (scalar_found != batch_found)
+    {
+        printf("   !MISMATCH! Scalar lookups found %ld names\n", scalar_found);
+    }
+    if (threads > 1 && concurrent_found != batch_found)
+    {
+        printf("   !MISMATCH! Concurrent lookups found %ld names\n", concurrent_found);
+    }
+
+    if (options->table_options.trace != NULL)
+    {
+        trace_ring_flush(options->table_options.trace);
+    }
+    free(keys);
+    free(sizes);
+    free(values);
+    free(found);
+    if (names != NULL)
+    {
+        munmap(names, size);
+    }
+}
+
+/**
+ * Frees the table once the trace writer is done with its keys.
+ */
+void finish_table(name_table *table, const program_options *options)
+{
+    if (options->table_options.trace != NULL)
+    {
+        trace_ring_flush(options->table_options.trace);
+    }
+    name_table_free(table);
+}
+
+/**
+ * Writes the table to the --save path, if there is one.
+ */
+void save_table(name_table *table, const program_options *options)
+{
+    if (options->save_path != NULL)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (hash_table_save(table->chained, options->save_path))
+        {
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            printf("Saved snapshot to %s in %.3f ms\n\n", options->save_path, elapsed_ms(start, end));
+        }
+    }
+}
+
+/**
+ * Runs the program with the specified buffer.
+ * The names in the buffer are newline-delimited. CRLF line endings and a missing final newline are accepted.
+ */
+void run_with_buffer(const char *names, size_t size, const program_options *options)
+{
+    if (options->compare_hashes)
+    {
+        compare_hashes(names, size, options);
+        return;
+    }
+
+    name_table table = name_table_create(options->backend, HASH_TABLE_CAPACITY, &options->table_options);
+
+    printf("Filling hash table...\n");
+    fill_table(&table, names, size, options);
+    printf("Hash table filled!\n\n");
+
+    save_table(&table, options);
+    print_report(&table, options);
+    if (options->join_path != NULL)
+    {
+        run_join(&table, options);
+    }
+    finish_table(&table, options);
+}
+
+/**
+ * Runs the program with a saved snapshot instead of building the table from a names file.
+ */
+int run_with_snapshot(const program_options *options)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    hash_table_snapshot *snapshot = hash_table_open(options->snapshot_path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (snapshot == NULL)
+    {
+        return 1;
+    }
+    printf("Opened snapshot %s in %.3f ms\n\n", options->snapshot_path, elapsed_ms(start, end));
+
+    name_table table = name_table_from_snapshot(snapshot);
+    print_report(&table, options);
+    if (options->join_path != NULL)
+    {
+        run_join(&table, options);
+    }
+    name_table_free(&table);
+    return 0;
+}
+
+/**
+ * Runs the program by reading the whole file into a buffer.
+ */
+int run_with_read(FILE *fp, const program_options *options)
+{
+    // Determine the file size.
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        perror("Unable to determine file size");
+        return 1;
+    }
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *names = malloc(size);
+
+    // Read file into buffer.
+    if (fread(names, sizeof(char), size, fp) != size)
+    {
+        perror("Unable to read file");
+        free(names);
+        return 1;
+    }
+    run_with_buffer(names, size, options);
+
+    free(names);
+    return 0;
+}
+
+/**
+ * Runs the program by mapping the file into memory.
+ * The keys in the table point straight into the mapping, so the file is never copied.
+ */
+int run_with_mmap(FILE *fp, const program_options *options)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0)
+    {
+        perror("Unable to stat file");
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0)
+    {
+        run_with_buffer(NULL, 0, options);
+        return 0;
+    }
+
+    char *names = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (names == MAP_FAILED)
+    {
+        perror("Unable to map file");
+        return 1;
+    }
+    // The names are parsed front to back, so let the kernel read ahead aggressively.
+    madvise(names, size, MADV_SEQUENTIAL);
+    run_with_buffer(names, size, options);
+
+    munmap(names, size);
+    return 0;
+}
+
+/**
+ * Runs the program by reading the input in chunks.
+ * Every chunk is kept in an arena that lives as long as the table, since the keys point into it.
+ * A name that is split between two chunks is carried over to the start of the next chunk.
+ */
+int run_with_stream(FILE *fp, const program_options *options)
+{
+    if (options->compare_hashes)
+    {
+        fprintf(stderr, "--compare-hashes needs the whole input, which streaming does not provide.\n");
+        return 1;
+    }
+
+    arena *chunks = arena_create(STREAM_CHUNK_SIZE);
+    name_table table = name_table_create(options->backend, HASH_TABLE_CAPACITY, &options->table_options);
+
+    printf("Filling hash table...\n");
+    int person_id = 0;
+    const char *carry = NULL;
+    size_t carry_size = 0;
+    size_t read;
+    do
+    {
+        char *chunk = arena_alloc(chunks, carry_size + STREAM_CHUNK_SIZE, 1);
+        if (carry_size > 0)
+        {
+            memcpy(chunk, carry, carry_size);
+        }
+        read = fread(chunk + carry_size, sizeof(char), STREAM_CHUNK_SIZE, fp);
+        size_t size = carry_size + read;
+        size_t consumed = fill_table_from(&table, chunk, size, read == 0, &person_id, options);
+        carry = chunk + consumed;
+        carry_size = size - consumed;
+    } while (read > 0);
+    printf("Hash table filled!\n\n");
+
+    int result = 0;
+    if (ferror(fp))
+    {
+        perror("Unable to read input");
+        result = 1;
+    }
+    else
+    {
+        save_table(&table, options);
+        print_report(&table, options);
+        if (options->join_path != NULL)
+        {
+            run_join(&table, options);
+        }
+    }
+
+    finish_table(&table, options);
+    arena_free(chunks);
+    return result;
+}
+
+/**
+ * Runs the program using a file.
+ * The names in the file are newline-delimited.
+ */
+int run_with_file(FILE *fp, const program_options *options)
+{
+    input_mode input = options->input;
+    if (input == INPUT_AUTO)
+    {
+        struct stat st;
+        bool regular = fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode);
+        input = regular ? INPUT_MMAP : INPUT_STREAM;
+    }
+
+    switch (input)
+    {
+    case INPUT_MMAP:
+        return run_with_mmap(fp, options);
+    case INPUT_READ:
+        return run_with_read(fp, options);
+    default:
+        return run_with_stream(fp, options);
+    }
+}
+
+/**
+ * Opens the file and runs the program with it. The file path "-" reads from stdin.
+ */
+int handle_file(const program_options *options)
+{
+    if (strcmp(options->file_path, "-") == 0)
+    {
+        return run_with_file(stdin, options);
+    }
+
+    FILE *file = fopen(options->file_path, "r");
+
+    if (file == NULL)
+    {
+        perror("Unable to open file.");
+        return 1;
+    }
+    int result = run_with_file(file, options);
+    fclose(file);
+    return result;
+}
+
+void print_help()
+{
+    printf(
+        "You must specify which file to read from as an argument to the program.\n"
+        "Usage: texthashtable [options] <file_name>\n"
+        "E.g. ./texthashtable ~/navn.txt\n"
+        "Use - as the file name to read from stdin.\n"
+        "\n"
+        "Options:\n"
+        "   --input=<mode>     How the file is read: auto, mmap, read or stream (default: auto)\n"
+        "   --backend=<name>   Table implementation: chained, swiss, typed, perfect or sharded (default: chained)\n"
+        "                      NOTE: perfect builds a static index once every name is read\n"
+        "   --shards=<n>       Shards of the sharded backend, rounded up to a power of two (default: 16)\n"
+        "   --rehash=<mode>    How the table grows: none, full or incremental (default: incremental)\n"
+        "   --max-load=<f>     Load factor that triggers growth (default: 1.0)\n"
+        "   --rehash-step=<n>  Buckets migrated per operation in incremental mode (default: 4)\n"
+        "   --hash=<name>      Hash function: auto, rotxor, fnv1a64, wyhash, xxh64, crc32c or aes (default: auto)\n"
+        "                      NOTE: the typed and perfect backends always use wyhash\n"
+        "   --compare-hashes   Build the table with every hash function and compare collisions and timings\n"
+        "   --allocator=<name> Entry allocator: arena or heap (default: arena)\n"
+        "   --bloom=<bits>     Check a Bloom filter with this many bits per key before the chains (default: 0, none)\n"
+        "   --keys=<mode>      Key storage of the chained and sharded backends: borrowed, inline or copy (default: inline)\n"
+        "   --scanner=<name>   Newline scanner: auto, avx2, sse2, neon or memchr (default: auto)\n"
+        "   --pages=<size>     Pages of the table memory: default, thp, 2m or 1g (default: default)\n"
+        "   --numa=<mode>      NUMA placement of the table memory: default, local or interleave (default: default)\n"
+        "   --trace            Write every collision to stderr from a background thread\n"
+        "   --join=<file>      Look up every name in the file, with and without batching, and time it\n"
+        "   --save=<file>      Save the built table as a snapshot (chained backend only)\n"
+        "   --snapshot=<file>  Map a saved snapshot instead of reading a names file, which is then not needed\n"
+        "   --threads=<n>      Build the table on n threads (default: 1)\n"
+        "                      NOTE: only the chained backend builds in parallel, and not with --input=stream\n"
+        "                      NOTE: the sharded backend instead runs the --join lookups on n threads\n");
+}
+
+/**
+ * Parses the command line into the program options.
+ * Returns false if the arguments are invalid.
+ */
+bool parse_options(int argc, char *const argv[], program_options *options)
+{
+    enum
+    {
+        OPTION_INPUT = 256,
+        OPTION_BACKEND,
+        OPTION_REHASH,
+        OPTION_MAX_LOAD,
+        OPTION_REHASH_STEP,
+        OPTION_HASH,
+        OPTION_COMPARE_HASHES,
+        OPTION_ALLOCATOR,
+        OPTION_SCANNER,
+        OPTION_TRACE,
+        OPTION_JOIN,
+        OPTION_PAGES,
+        OPTION_NUMA,
+        OPTION_SAVE,
+        OPTION_SNAPSHOT,
+        OPTION_THREADS,
+        OPTION_SHARDS,
+        OPTION_KEYS,
+        OPTION_BLOOM,
+    };
+    const struct option long_options[] = {
+        {"input", required_argument, NULL, OPTION_INPUT},
+        {"backend", required_argument, NULL, OPTION_BACKEND},
+        {"rehash", required_argument, NULL, OPTION_REHASH},
+        {"max-load", required_argument, NULL, OPTION_MAX_LOAD},
+        {"rehash-step", required_argument, NULL, OPTION_REHASH_STEP},
+        {"hash", required_argument, NULL, OPTION_HASH},
+        {"compare-hashes", no_argument, NULL, OPTION_COMPARE_HASHES},
+        {"allocator", required_argument, NULL, OPTION_ALLOCATOR},
+        {"scanner", required_argument, NULL, OPTION_SCANNER},
+        {"trace", no_argument, NULL, OPTION_TRACE},
+        {"join", required_argument, NULL, OPTION_JOIN},
+        {"pages", required_argument, NULL, OPTION_PAGES},
+        {"numa", required_argument, NULL, OPTION_NUMA},
+        {"save", required_argument, NULL, OPTION_SAVE},
+        {"snapshot", required_argument, NULL, OPTION_SNAPSHOT},
+        {"threads", required_argument, NULL, OPTION_THREADS},
+        {"shards", required_argument, NULL, OPTION_SHARDS},
+        {"keys", required_argument, NULL, OPTION_KEYS},
+        {"bloom", required_argument, NULL, OPTION_BLOOM},
+        {NULL, 0, NULL, 0}};
+
+    *options = (program_options){
+        .file_path = NULL,
+        .input = INPUT_AUTO,
+        .backend = BACKEND_CHAINED,
+        .hash_name = hash_algorithm_best()->name,
+        .compare_hashes = false,
+        .allocator_name = "arena",
+        .heap_allocator = hash_table_heap_allocator(),
+        .scanner = newline_scanner_find("auto"),
+        .trace = false,
+        .join_path = NULL,
+        .save_path = NULL,
+        .snapshot_path = NULL,
+        .threads = 1,
+        .table_options = hash_table_default_options(),
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case OPTION_INPUT:
+            if (strcmp(optarg, "auto") == 0)
+            {
+                options->input = INPUT_AUTO;
+            }
+            else if (strcmp(optarg, "mmap") == 0)
+            {
+                options->input = INPUT_MMAP;
+            }
+            else if (strcmp(optarg, "read") == 0)
+            {
+                options->input = INPUT_READ;
+            }
+            else if (strcmp(optarg, "stream") == 0)
+            {
+                options->input = INPUT_STREAM;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown input mode '%s'.\n", optarg);
+                return false;
+            }
+            break;
+        case OPTION_BACKEND:
+            if (strcmp(optarg, "chained") == 0)
+            {
+                options->backend = BACKEND_CHAINED;
+            }
+            else if (strcmp(optarg, "swiss") == 0)
+            {
+                options->backend = BACKEND_SWISS;
+            }
+            else if (strcmp(optarg, "typed") == 0)
+            {
+                options->backend = BACKEND_TYPED;
+            }
+            else if (strcmp(optarg, "perfect") == 0)
+            {
+                options->backend = BACKEND_PERFECT;
+            }
+            else if (strcmp(optarg, "sharded") == 0)
+            {
+                options->backend = BACKEND_SHARDED;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown backend '%s'.\n", optarg);
+                return false;
+            }
+            break;
+        case OPTION_REHASH:
+            if (strcmp(optarg, "none") == 0)
+            {
+                options->table_options.rehash_mode = HASH_TABLE_REHASH_NONE;
+            }
+            else if (strcmp(optarg, "full") == 0)
+            {
+                options->table_options.rehash_mode = HASH_TABLE_REHASH_FULL;
+            }
+            else if (strcmp(optarg, "incremental") == 0)
+            {
+                options->table_options.rehash_mode = HASH_TABLE_REHASH_INCREMENTAL;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown rehash mode '%s'.\n", optarg);
+                return false;
+            }
+            break;
+        case OPTION_MAX_LOAD:
+            options->table_options.max_load_factor = strtof(optarg, NULL);
+            if (options->table_options.max_load_factor <= 0.0f)
+            {
+                fprintf(stderr, "The max load factor must be positive.\n");
+                return false;
+            }
+            break;
+        case OPTION_REHASH_STEP:
+            options->table_options.rehash_step = strtoul(optarg, NULL, 10);
+            break;
+        case OPTION_HASH:
+        {
+            const hash_algorithm *algorithm = hash_algorithm_find(optarg);
+            if (algorithm == NULL)
+            {
+                fprintf(stderr, "Unknown or unsupported hash function '%s'.\n", optarg);
+                return false;
+            }
+            options->hash_name = algorithm->name;
+            options->table_options.hash = algorithm->func;
+            break;
+        }
+        case OPTION_COMPARE_HASHES:
+            options->compare_hashes = true;
+            break;
+        case OPTION_ALLOCATOR:
+            if (strcmp(optarg, "arena") == 0)
+            {
+                options->table_options.allocator = NULL;
+            }
+            else if (strcmp(optarg, "heap") == 0)
+            {
+                options->table_options.allocator = &options->heap_allocator;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown allocator '%s'.\n", optarg);
+                return false;
+            }
+            options->allocator_name = optarg;
+            break;
+        case OPTION_SCANNER:
+            options->scanner = newline_scanner_find(optarg);
+            if (options->scanner == NULL)
+            {
+                fprintf(stderr, "Unknown or unsupported newline scanner '%s'.\n", optarg);
+                return false;
+            }
+            break;
+        case OPTION_TRACE:
+            options->trace = true;
+            break;
+        case OPTION_JOIN:
+            options->join_path = optarg;
+            break;
+        case OPTION_PAGES:
+        {
+            int pages = find_mode_name(page_mode_names, sizeof(page_mode_names) / sizeof(page_mode_names[0]), optarg);
+            if (pages < 0)
+            {
+                fprintf(stderr, "Unknown page size '%s'.\n", optarg);
+                return false;
+            }
+            options->table_options.memory.pages = pages;
+            break;
+        }
+        case OPTION_NUMA:
+        {
+            int numa = find_mode_name(numa_mode_names, sizeof(numa_mode_names) / sizeof(numa_mode_names[0]), optarg);
+            if (numa < 0)
+            {
+                fprintf(stderr, "Unknown NUMA placement '%s'.\n", optarg);
+                return false;
+            }
+            options->table_options.memory.numa = numa;
+            break;
+        }
+        case OPTION_SAVE:
+            options->save_path = optarg;
+            break;
+        case OPTION_SNAPSHOT:
+            options->snapshot_path = optarg;
+            break;
+        case OPTION_THREADS:
+            options->threads = atoi(optarg);
+            if (options->threads < 1)
+            {
+                fprintf(stderr, "The number of threads must be at least 1.\n");
+                return false;
+            }
+            break;
+        case OPTION_SHARDS:
+            options->table_options.shards = strtoul(optarg, NULL, 10);
+            if (options->table_options.shards < 1 || options->table_options.shards > 65536)
+            {
+                fprintf(stderr, "The number of shards must be between 1 and 65536.\n");
+                return false;
+            }
+            break;
+        case OPTION_KEYS:
+        {
+            int storage = find_mode_name(hash_table_key_storage_names, sizeof(hash_table_key_storage_names) / sizeof(hash_table_key_storage_names[0]), optarg);
+            if (storage < 0)
+            {
+                fprintf(stderr, "Unknown key storage '%s'.\n", optarg);
+                return false;
+            }
+            options->table_options.key_storage = storage;
+            break;
+        }
+        case OPTION_BLOOM:
+        {
+            long bits = strtol(optarg, NULL, 10);
+            if (bits < 0 || bits > 64)
+            {
+                fprintf(stderr, "The Bloom filter bits per key must be between 0 and 64.\n");
+                return false;
+            }
+            options->table_options.bloom_bits_per_key = (unsigned int)bits;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (options->save_path != NULL && (options->backend != BACKEND_CHAINED || options->compare_hashes))
+    {
+        fprintf(stderr, "Only a table built with the chained backend can be saved.\n");
+        return false;
+    }
+    if (options->snapshot_path != NULL)
+    {
+        options->backend = BACKEND_SNAPSHOT;
+        return true;
+    }
+    if (optind >= argc)
+    {
+        return false;
+    }
+    options->file_path = argv[optind];
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    program_options options;
+    if (!parse_options(argc, argv, &options))
+    {
+        print_help();
+        return 1;
+    }
+
+    if (options.trace)
+    {
+        options.table_options.trace = trace_ring_create(TRACE_RING_CAPACITY, stderr);
+    }
+    int result = options.snapshot_path != NULL ? run_with_snapshot(&options) : handle_file(&options);
+    if (options.trace)
+    {
+        trace_ring_free(options.table_options.trace);
+    }
+    return result;
 }
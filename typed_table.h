@@ -0,0 +1,326 @@
+#ifndef TYPED_TABLE_H
+#define TYPED_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***************************************
+ * Typed tables                        *
+ ***************************************/
+
+/*
+ * TYPED_TABLE_DEFINE(name, key_type, value_type, hash, equal) generates an open-addressing
+ * hash table specialized for one key and value type:
+ *
+ *   uint64_t hash(key_type key, uint64_t seed)
+ *   bool equal(key_type a, key_type b)
+ *
+ * hash and equal can be functions or function-like macros. They are expanded into the
+ * generated code, so for scalar and fixed-size keys the compiler inlines the key
+ * comparison instead of calling memcmp, and the slots store the keys inline.
+ *
+ * Every instantiation shares the same probe implementation: linear probing over a power of
+ * two number of slots, with a control byte per slot. A used slot's control byte holds 7 bits of
+ * the hash, so most slots of other keys are skipped without comparing keys at all.
+ * The table doubles when it would become more than 7/8 full, unless it was created with
+ * name_create_fixed: a fixed table keeps its capacity and refuses new keys once every slot is used.
+ *
+ * The generated functions are name_create, name_create_fixed, name_free, name_add, name_lookup,
+ * name_lookup_batch, name_probe_length, name_entries, name_capacity, name_collisions, name_growths,
+ * name_load_factor and name_bytes.
+ */
+
+#define TYPED_TABLE_MIN_CAPACITY 16
+#define TYPED_TABLE_BATCH_SIZE 16
+#define TYPED_TABLE_EMPTY 0
+
+/**
+ * Returns the control byte for a used slot with the hash. It is never TYPED_TABLE_EMPTY.
+ */
+static inline uint8_t typed_table_tag(uint64_t hash)
+{
+    return 0x80 | (uint8_t)(hash >> 57);
+}
+
+/**
+ * Bijective 64 bit mixer (the murmur3 finalizer).
+ */
+static inline uint64_t typed_mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * Hash and equality for scalar keys.
+ */
+
+#define TYPED_HASH_SCALAR(key, seed) typed_mix64((uint64_t)(key) ^ (seed) ^ 0x9e3779b97f4a7c15ull)
+#define TYPED_EQUAL_SCALAR(a, b) ((a) == (b))
+
+/**
+ * TYPED_TABLE_FIXED_KEY(name, size) defines a key type of size bytes, with name_hash and name_equal.
+ * Both work a 64 bit word at a time with a trip count known at compile time.
+ */
+#define TYPED_TABLE_FIXED_KEY(name, size)                                     \
+    typedef struct                                                           \
+    {                                                                        \
+        unsigned char bytes[size];                                           \
+    } name;                                                                  \
+                                                                             \
+    static inline uint64_t name##_word(const name *key, size_t offset)       \
+    {                                                                        \
+        uint64_t word = 0;                                                   \
+        memcpy(&word, key->bytes + offset, (size) - offset < 8 ? (size) - offset : 8); \
+        return word;                                                         \
+    }                                                                        \
+                                                                             \
+    static inline uint64_t name##_hash(name key, uint64_t seed)              \
+    {                                                                        \
+        uint64_t h = seed ^ (size);                                          \
+        for (size_t offset = 0; offset < (size); offset += 8)                \
+        {                                                                    \
+            h = typed_mix64(h ^ name##_word(&key, offset));                  \
+        }                                                                    \
+        return h;                                                            \
+    }                                                                        \
+                                                                             \
+    static inline bool name##_equal(name a, name b)                          \
+    {                                                                        \
+        uint64_t difference = 0;                                             \
+        for (size_t offset = 0; offset < (size); offset += 8)                \
+        {                                                                    \
+            difference |= name##_word(&a, offset) ^ name##_word(&b, offset); \
+        }                                                                    \
+        return difference == 0;                                              \
+    }
+
+/**
+ * Key type for variable length strings. The table stores the pointer, not a copy of the bytes.
+ */
+typedef struct
+{
+    const void *data;
+    size_t size;
+} typed_string;
+
+static inline bool typed_string_equal(typed_string a, typed_string b)
+{
+    return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+}
+
+#define TYPED_TABLE_DEFINE(name, key_type, value_type, hash, equal)                                   \
+    typedef struct                                                                                    \
+    {                                                                                                 \
+        key_type key;                                                                                 \
+        value_type value;                                                                             \
+    } name##_slot;                                                                                    \
+                                                                                                      \
+    typedef struct                                                                                    \
+    {                                                                                                 \
+        size_t capacity;                                                                              \
+        size_t entries;                                                                               \
+        size_t collisions;                                                                            \
+        size_t growths;                                                                               \
+        bool fixed;                                                                                   \
+        uint64_t seed;                                                                                \
+        uint8_t *ctrl;                                                                                \
+        name##_slot *slots;                                                                           \
+    } name;                                                                                           \
+                                                                                                      \
+    /* Creates a table with at least the capacity in slots, rounded up to a power of two. */         \
+    static inline name *name##_create(size_t capacity, uint64_t seed)                                 \
+    {                                                                                                 \
+        name *table = (name *)calloc(1, sizeof(name));                                                \
+        table->capacity = TYPED_TABLE_MIN_CAPACITY;                                                   \
+        while (table->capacity < capacity)                                                            \
+        {                                                                                             \
+            table->capacity *= 2;                                                                     \
+        }                                                                                             \
+        table->seed = seed;                                                                           \
+        table->ctrl = (uint8_t *)calloc(table->capacity, 1);                                          \
+        table->slots = (name##_slot *)malloc(table->capacity * sizeof(name##_slot));                  \
+        return table;                                                                                 \
+    }                                                                                                 \
+                                                                                                      \
+    /* Creates a table like name_create that never grows. */                                         \
+    static inline name *name##_create_fixed(size_t capacity, uint64_t seed)                           \
+    {                                                                                                 \
+        name *table = name##_create(capacity, seed);                                                  \
+        table->fixed = true;                                                                          \
+        return table;                                                                                 \
+    }                                                                                                 \
+                                                                                                      \
+    static inline void name##_free(name *table)                                                       \
+    {                                                                                                 \
+        free(table->ctrl);                                                                            \
+        free(table->slots);                                                                           \
+        free(table);                                                                                  \
+    }                                                                                                 \
+                                                                                                      \
+    /* The probe shared by all operations. Returns true and the slot of the key if it is in the      \
+       table, otherwise false and the empty slot where it belongs, or the capacity if a full         \
+       fixed table has none. Counts the slots passed. */                                             \
+    static inline bool name##_find(const name *table, key_type key, uint64_t h, size_t *slot,        \
+                                   size_t *probes)                                                    \
+    {                                                                                                 \
+        const size_t mask = table->capacity - 1;                                                      \
+        const uint8_t tag = typed_table_tag(h);                                                       \
+        size_t i = h & mask;                                                                          \
+        for (size_t step = 0; step < table->capacity; step++, i = (i + 1) & mask)                     \
+        {                                                                                             \
+            uint8_t ctrl = table->ctrl[i];                                                            \
+            if (ctrl == TYPED_TABLE_EMPTY || (ctrl == tag && equal(table->slots[i].key, key)))        \
+            {                                                                                         \
+                *slot = i;                                                                            \
+                *probes = step;                                                                       \
+                return ctrl != TYPED_TABLE_EMPTY;                                                     \
+            }                                                                                         \
+        }                                                                                             \
+        *slot = table->capacity;                                                                      \
+        *probes = table->capacity;                                                                    \
+        return false;                                                                                 \
+    }                                                                                                 \
+                                                                                                      \
+    static inline void name##_grow(name *table)                                                       \
+    {                                                                                                 \
+        uint8_t *old_ctrl = table->ctrl;                                                              \
+        name##_slot *old_slots = table->slots;                                                        \
+        size_t old_capacity = table->capacity;                                                        \
+                                                                                                      \
+        table->capacity *= 2;                                                                         \
+        table->ctrl = (uint8_t *)calloc(table->capacity, 1);                                          \
+        table->slots = (name##_slot *)malloc(table->capacity * sizeof(name##_slot));                  \
+        for (size_t i = 0; i < old_capacity; i++)                                                     \
+        {                                                                                             \
+            if (old_ctrl[i] != TYPED_TABLE_EMPTY)                                                     \
+            {                                                                                         \
+                size_t slot, probes;                                                                  \
+                name##_find(table, old_slots[i].key, hash(old_slots[i].key, table->seed), &slot,      \
+                            &probes);                                                                 \
+                table->ctrl[slot] = old_ctrl[i];                                                      \
+                table->slots[slot] = old_slots[i];                                                    \
+            }                                                                                         \
+        }                                                                                             \
+        table->growths++;                                                                             \
+        free(old_ctrl);                                                                               \
+        free(old_slots);                                                                              \
+    }                                                                                                 \
+                                                                                                      \
+    /* Adds the key, or replaces its value if it is already in the table.                            \
+       Returns true if the key was added, false if it was replaced or a fixed table is full. */      \
+    static inline bool name##_add(name *table, key_type key, value_type value)                        \
+    {                                                                                                 \
+        if (!table->fixed && (table->entries + 1) * 8 > table->capacity * 7)                          \
+        {                                                                                             \
+            name##_grow(table);                                                                       \
+        }                                                                                             \
+        uint64_t h = hash(key, table->seed);                                                          \
+        size_t slot, probes;                                                                          \
+        if (name##_find(table, key, h, &slot, &probes))                                               \
+        {                                                                                             \
+            table->slots[slot].value = value;                                                         \
+            return false;                                                                             \
+        }                                                                                             \
+        if (slot == table->capacity)                                                                  \
+        {                                                                                             \
+            return false;                                                                             \
+        }                                                                                             \
+        table->ctrl[slot] = typed_table_tag(h);                                                       \
+        table->slots[slot].key = key;                                                                 \
+        table->slots[slot].value = value;                                                             \
+        table->entries++;                                                                             \
+        table->collisions += probes;                                                                  \
+        return true;                                                                                  \
+    }                                                                                                 \
+                                                                                                      \
+    /* Looks up the key. If found and value is not NULL, the value is written to it. */              \
+    static inline bool name##_lookup(const name *table, key_type key, value_type *value)              \
+    {                                                                                                 \
+        size_t slot, probes;                                                                          \
+        if (!name##_find(table, key, hash(key, table->seed), &slot, &probes))                         \
+        {                                                                                             \
+            return false;                                                                             \
+        }                                                                                             \
+        if (value != NULL)                                                                            \
+        {                                                                                             \
+            *value = table->slots[slot].value;                                                        \
+        }                                                                                             \
+        return true;                                                                                  \
+    }                                                                                                 \
+                                                                                                      \
+    /* Looks up n keys. The home slots of a group of keys are prefetched before any is probed.       \
+       values_out may be NULL. */                                                                     \
+    static inline void name##_lookup_batch(const name *table, const key_type keys[], size_t n,        \
+                                           value_type values_out[], bool found_out[])                 \
+    {                                                                                                 \
+        uint64_t hashes[TYPED_TABLE_BATCH_SIZE];                                                      \
+        for (size_t base = 0; base < n; base += TYPED_TABLE_BATCH_SIZE)                               \
+        {                                                                                             \
+            size_t count = n - base < TYPED_TABLE_BATCH_SIZE ? n - base : TYPED_TABLE_BATCH_SIZE;     \
+            for (size_t i = 0; i < count; i++)                                                        \
+            {                                                                                         \
+                hashes[i] = hash(keys[base + i], table->seed);                                        \
+                __builtin_prefetch(&table->ctrl[hashes[i] & (table->capacity - 1)]);                  \
+                __builtin_prefetch(&table->slots[hashes[i] & (table->capacity - 1)]);                 \
+            }                                                                                         \
+            for (size_t i = 0; i < count; i++)                                                        \
+            {                                                                                         \
+                size_t slot, probes;                                                                  \
+                bool found = name##_find(table, keys[base + i], hashes[i], &slot, &probes);           \
+                found_out[base + i] = found;                                                          \
+                if (found && values_out != NULL)                                                      \
+                {                                                                                     \
+                    values_out[base + i] = table->slots[slot].value;                                  \
+                }                                                                                     \
+            }                                                                                         \
+        }                                                                                             \
+    }                                                                                                 \
+                                                                                                      \
+    /* Returns the number of slots a lookup of the key inspects, 1 if it is in its home slot. */     \
+    static inline size_t name##_probe_length(const name *table, key_type key)                         \
+    {                                                                                                 \
+        size_t slot, probes;                                                                          \
+        name##_find(table, key, hash(key, table->seed), &slot, &probes);                              \
+        return probes + 1;                                                                            \
+    }                                                                                                 \
+                                                                                                      \
+    static inline size_t name##_entries(const name *table)                                            \
+    {                                                                                                 \
+        return table->entries;                                                                        \
+    }                                                                                                 \
+                                                                                                      \
+    static inline size_t name##_capacity(const name *table)                                           \
+    {                                                                                                 \
+        return table->capacity;                                                                       \
+    }                                                                                                 \
+                                                                                                      \
+    static inline size_t name##_collisions(const name *table)                                         \
+    {                                                                                                 \
+        return table->collisions;                                                                     \
+    }                                                                                                 \
+                                                                                                      \
+    static inline size_t name##_growths(const name *table)                                            \
+    {                                                                                                 \
+        return table->growths;                                                                        \
+    }                                                                                                 \
+                                                                                                      \
+    static inline float name##_load_factor(const name *table)                                         \
+    {                                                                                                 \
+        return (float)table->entries / (float)table->capacity;                                        \
+    }                                                                                                 \
+                                                                                                      \
+    /* Returns the number of bytes used for the control bytes and slots. */                          \
+    static inline size_t name##_bytes(const name *table)                                              \
+    {                                                                                                 \
+        return table->capacity * (1 + sizeof(name##_slot));                                           \
+    }
+
+#endif